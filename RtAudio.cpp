@@ -45,6 +45,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <climits>
+#include <ctime>
+
+#if !defined(__WINDOWS_DS__) && !defined(__WINDOWS_ASIO__)
+  #include <sys/mman.h>
+  #include <unistd.h>
+  #include <cstdio>
+#endif
 
 // Static variable definitions.
 const unsigned int RtApi::MAX_SAMPLE_RATES = 14;
@@ -67,6 +74,33 @@ const unsigned int RtApi::SAMPLE_RATES[] = {
 #else
   #define MUTEX_INITIALIZE(A) abs(*A) // dummy definitions
   #define MUTEX_DESTROY(A)    abs(*A) // dummy definitions
+  #define MUTEX_LOCK(A)       abs(*A) // dummy definitions
+  #define MUTEX_UNLOCK(A)     abs(*A) // dummy definitions
+#endif
+
+// The stream counters are written by the callback thread while other
+// threads copy or reset them.
+#if defined(__GNUC__)
+  #define STATS_LOAD(A)       __atomic_load_n(&(A), __ATOMIC_RELAXED)
+  #define STATS_STORE(A, V)   __atomic_store_n(&(A), (V), __ATOMIC_RELAXED)
+  #define STATS_ADD(A, V)     __atomic_fetch_add(&(A), (V), __ATOMIC_RELAXED)
+#else
+  #define STATS_LOAD(A)       (A)
+  #define STATS_STORE(A, V)   ((A) = (V))
+  #define STATS_ADD(A, V)     ((A) += (V))
+#endif
+
+// The arena holder counts are raised by the callback thread without a
+// lock, and dropped by whichever thread lets go of a buffer.
+#if defined(__GNUC__)
+  #define HOLDERS_ADD(A)      __atomic_add_fetch(&(A), 1, __ATOMIC_RELAXED)
+  #define HOLDERS_SUB(A)      __atomic_sub_fetch(&(A), 1, __ATOMIC_ACQ_REL)
+#elif defined(_MSC_VER)
+  #define HOLDERS_ADD(A)      InterlockedIncrement(&(A))
+  #define HOLDERS_SUB(A)      InterlockedDecrement(&(A))
+#else
+  #define HOLDERS_ADD(A)      (++(A))
+  #define HOLDERS_SUB(A)      (--(A))
 #endif
 
 // *************************************************** //
@@ -196,6 +230,25 @@ void RtAudio :: openStream( RtAudio::StreamParameters *outputParameters,
                              userData, options );
 }
 
+unsigned int RtAudio :: statsBucket( unsigned long long nanos ) throw()
+{
+  // Log-linear: shift the time down until it has five significant
+  // bits, the shift picks the power of two and the bits the bucket.
+  if ( nanos < 32 ) return (unsigned int) nanos;
+  unsigned int shift = 0;
+  while ( ( nanos >> shift ) >= 32 ) shift++;
+  if ( shift > 36 ) return STATS_BUCKETS - 1;
+  return shift * 16 + (unsigned int) ( nanos >> shift );
+}
+
+unsigned long long RtAudio :: statsBucketNanos( unsigned int bucket ) throw()
+{
+  if ( bucket < 32 ) return bucket;
+  if ( bucket >= STATS_BUCKETS ) bucket = STATS_BUCKETS - 1;
+  unsigned long long significand = bucket % 16 + 16;
+  return significand << ( bucket / 16 - 1 );
+}
+
 // *************************************************** //
 //
 // Public RtApi definitions (see end of file for
@@ -212,6 +265,9 @@ RtApi :: RtApi()
   stream_.userBuffer[1] = 0;
   MUTEX_INITIALIZE( &stream_.mutex );
   showWarnings_ = true;
+  memset( &stats_, 0, sizeof( stats_ ) );
+  traceHook_ = 0;
+  traceData_ = 0;
 }
 
 RtApi :: ~RtApi()
@@ -303,6 +359,15 @@ unsigned int RtApi :: getDefaultInputDevice( void )
   return 0;
 }
 
+std::vector<RtAudio::DeviceInfo> RtApi :: getAllDeviceInfo( void )
+{
+  // APIs without a saved device list probe every device each time.
+  std::vector<RtAudio::DeviceInfo> devices( getDeviceCount() );
+  for ( unsigned int i=0; i<devices.size(); i++ )
+    devices[i] = getDeviceInfo( i );
+  return devices;
+}
+
 unsigned int RtApi :: getDefaultOutputDevice( void )
 {
   // Should be implemented in subclasses if possible.
@@ -380,6 +445,110 @@ unsigned int RtApi :: getStreamSampleRate( void )
  return stream_.sampleRate;
 }
 
+void RtApi :: getStreamStats( RtAudio::StreamStats &stats )
+{
+  verifyStream();
+
+  stats.periods = STATS_LOAD( stats_.periods );
+  stats.underflows = STATS_LOAD( stats_.underflows );
+  stats.overflows = STATS_LOAD( stats_.overflows );
+  stats.callbackNanos = STATS_LOAD( stats_.callbackNanos );
+  stats.callbackMax = STATS_LOAD( stats_.callbackMax );
+  stats.convertNanos = STATS_LOAD( stats_.convertNanos );
+  stats.convertMax = STATS_LOAD( stats_.convertMax );
+  stats.deviceNanos = STATS_LOAD( stats_.deviceNanos );
+  stats.deviceMax = STATS_LOAD( stats_.deviceMax );
+  stats.busyMax = STATS_LOAD( stats_.busyMax );
+  for ( unsigned int i=0; i<RtAudio::STATS_BUCKETS; i++ )
+    stats.histogram[i] = STATS_LOAD( stats_.histogram[i] );
+}
+
+static bool lookupArena( char *buffer, unsigned long &bytes );
+
+void RtApi :: getStreamMemory( RtAudio::StreamMemory &memory )
+{
+  verifyStream();
+
+  for ( int i=0; i<2; i++ )
+    memory.userBytes[i] = stream_.userBuffer[i] ? userBufferBytes( i ) : 0;
+  memory.deviceBytes = stream_.deviceBuffer ? deviceBufferBytes() : 0;
+  memory.arenaBytes = stream_.arenaBytes;
+  memory.locked = stream_.arenaLocked;
+  memory.hugePages = stream_.arenaHugePages;
+
+  // User buffers exchanged in are mapped on their own, or allocated with
+  // malloc() and then neither aligned nor locked.
+  for ( int i=0; i<2; i++ ) {
+    char *buffer = stream_.userBuffer[i];
+    if ( !buffer || ( stream_.arena && buffer >= stream_.arena && buffer < stream_.arena + stream_.arenaBytes ) )
+      continue;
+    memory.hugePages = false;
+    if ( !lookupArena( buffer, memory.arenaBytes ) ) memory.locked = false;
+  }
+}
+
+void RtApi :: resetStreamStats( void )
+{
+  verifyStream();
+
+  // The callback thread only ever adds to the totals, so a period
+  // counted across the reset is either kept whole or dropped whole.
+  STATS_STORE( stats_.periods, 0 );
+  STATS_STORE( stats_.underflows, 0 );
+  STATS_STORE( stats_.overflows, 0 );
+  STATS_STORE( stats_.callbackNanos, 0 );
+  STATS_STORE( stats_.callbackMax, 0 );
+  STATS_STORE( stats_.convertNanos, 0 );
+  STATS_STORE( stats_.convertMax, 0 );
+  STATS_STORE( stats_.deviceNanos, 0 );
+  STATS_STORE( stats_.deviceMax, 0 );
+  STATS_STORE( stats_.busyMax, 0 );
+  for ( unsigned int i=0; i<RtAudio::STATS_BUCKETS; i++ )
+    STATS_STORE( stats_.histogram[i], 0 );
+}
+
+unsigned long long RtApi :: statsClock( void )
+{
+#if defined( CLOCK_MONOTONIC )
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+void RtApi :: statsAdd( unsigned long long &total, unsigned long long &max, unsigned long long nanos )
+{
+  STATS_ADD( total, nanos );
+  if ( nanos > STATS_LOAD( max ) ) STATS_STORE( max, nanos );
+}
+
+void RtApi :: statsCallback( RtAudioStreamStatus status, unsigned long long nanos )
+{
+  STATS_ADD( stats_.periods, 1 );
+  if ( status & RTAUDIO_OUTPUT_UNDERFLOW ) STATS_ADD( stats_.underflows, 1 );
+  if ( status & RTAUDIO_INPUT_OVERFLOW ) STATS_ADD( stats_.overflows, 1 );
+  statsAdd( stats_.callbackNanos, stats_.callbackMax, nanos );
+  STATS_ADD( stats_.histogram[RtAudio::statsBucket( nanos )], 1 );
+}
+
+static void holdArena( void *entry );
+
+char *RtApi :: exchangeUserBuffer( bool input, char *buffer )
+{
+  // No stream verification here, since this is only called from
+  // within the callback of an open stream.  The API callbackEvent()
+  // methods read stream_.userBuffer again after the callback returns,
+  // so the new buffer takes effect for the remainder of this period.
+  int mode = input ? 1 : 0;
+  char *previous = stream_.userBuffer[mode];
+  if ( stream_.arena && previous >= stream_.arena && previous < stream_.arena + stream_.arenaBytes )
+    holdArena( stream_.arenaEntry );
+  stream_.userBuffer[mode] = buffer;
+  return previous;
+}
+
 
 // *************************************************** //
 //
@@ -5098,9 +5267,115 @@ struct AlsaHandle {
 
 extern "C" void *alsaCallbackHandler( void * ptr );
 
+// Shared by the threads of one probeDevices() or mapDevices() call.
+// Whoever lets go of it last deletes it, which may be a probe thread
+// that timed out and only returns after the call did.
+struct AlsaProbe {
+  enum { WAITING, RUNNING, DONE, ABANDONED };
+
+  pthread_mutex_t mutex;
+  pthread_cond_t done_cv;
+  bool walk;               // list the devices of each card instead of probing them
+  std::vector< std::pair<int, int> > ids; // (card, subdevice) to probe
+  std::vector<RtAudio::DeviceInfo> infos;
+  std::vector< std::vector<int> > subdevices; // the devices found on each card
+  std::vector< std::vector<std::string> > warnings;
+  std::vector<int> state;
+  std::vector<struct timespec> started;
+  unsigned int next;       // the first device no thread took yet
+  unsigned int finished;   // devices done or abandoned
+  unsigned int workers;    // threads not stuck in a probe
+  unsigned int references;
+
+  AlsaProbe( std::vector< std::pair<int, int> > const &devices, bool walkCards )
+    :walk(walkCards), ids(devices), infos(devices.size()),
+     subdevices(devices.size()), warnings(devices.size()),
+     state(devices.size(), WAITING), started(devices.size()),
+     next(0), finished(0), workers(0), references(1)
+  {
+    pthread_mutex_init( &mutex, NULL );
+    pthread_cond_init( &done_cv, NULL );
+  }
+
+  ~AlsaProbe()
+  {
+    pthread_mutex_destroy( &mutex );
+    pthread_cond_destroy( &done_cv );
+  }
+
+  // Must be called with the mutex held, which it releases.
+  void release()
+  {
+    bool last = --references == 0;
+    pthread_mutex_unlock( &mutex );
+    if ( last ) delete this;
+  }
+};
+
+// Probe threads take the next waiting device or card until none is
+// left.  A thread whose device was abandoned has been replaced
+// meanwhile, so it leaves instead of taking another one.
+extern "C" void *alsaProbeHandler( void *ptr )
+{
+  AlsaProbe *probe = (AlsaProbe *) ptr;
+
+  pthread_mutex_lock( &probe->mutex );
+  while ( probe->next < probe->ids.size() ) {
+    unsigned int i = probe->next++;
+    probe->state[i] = AlsaProbe::RUNNING;
+    clock_gettime( CLOCK_REALTIME, &probe->started[i] );
+    pthread_cond_signal( &probe->done_cv ); // the waiter needs its deadline
+    std::pair<int, int> id = probe->ids[i];
+    pthread_mutex_unlock( &probe->mutex );
+
+    RtAudio::DeviceInfo info;
+    std::vector<int> subdevices;
+    std::vector<std::string> warnings;
+    if ( probe->walk )
+      RtApiAlsa::walkCard( id.first, subdevices, warnings );
+    else
+      RtApiAlsa::probeDevice( id.first, id.second, info, warnings );
+
+    pthread_mutex_lock( &probe->mutex );
+    if ( probe->state[i] == AlsaProbe::ABANDONED ) {
+      probe->release();
+      return NULL;
+    }
+    probe->infos[i] = info;
+    probe->subdevices[i].swap( subdevices );
+    probe->warnings[i].swap( warnings );
+    probe->state[i] = AlsaProbe::DONE;
+    probe->finished++;
+    pthread_cond_signal( &probe->done_cv );
+  }
+  probe->workers--;
+  pthread_cond_signal( &probe->done_cv );
+  probe->release();
+  return NULL;
+}
+
+// Must be called with the probe mutex held.
+static bool startAlsaProbeThread( AlsaProbe *probe )
+{
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init( &attr );
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+  probe->references++;
+  probe->workers++;
+  int result = pthread_create( &thread, &attr, alsaProbeHandler, probe );
+  pthread_attr_destroy( &attr );
+  if ( result ) {
+    probe->references--;
+    probe->workers--;
+  }
+  return result == 0;
+}
+
 RtApiAlsa :: RtApiAlsa()
+  :devicesSaved_(false), mapSaved_(false), probeTimeout_(2.0)
 {
-  // Nothing to do here.
+  streamIds_[0] = streamIds_[1] = std::make_pair( -1, -1 );
 }
 
 RtApiAlsa :: ~RtApiAlsa()
@@ -5108,44 +5383,88 @@ RtApiAlsa :: ~RtApiAlsa()
   if ( stream_.state != STREAM_CLOSED ) closeStream();
 }
 
-unsigned int RtApiAlsa :: getDeviceCount( void )
+void RtApiAlsa :: walkCard( int card, std::vector<int> &subdevices,
+                            std::vector<std::string> &warnings )
 {
-  unsigned nDevices = 0;
-  int result, subdevice, card;
+  std::ostringstream warning;
+  int result, subdevice;
   char name[64];
   snd_ctl_t *handle;
 
-  // Count cards and devices
-  card = -1;
+  sprintf( name, "hw:%d", card );
+  result = snd_ctl_open( &handle, name, SND_CTL_NONBLOCK );
+  if ( result < 0 ) {
+    warning << "RtApiAlsa::mapDevices: control open, card = " << card << ", " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    return;
+  }
+  subdevice = -1;
+  while( 1 ) {
+    result = snd_ctl_pcm_next_device( handle, &subdevice );
+    if ( result < 0 ) {
+      warning << "RtApiAlsa::mapDevices: control next device, card = " << card << ", " << snd_strerror( result ) << ".";
+      warnings.push_back( warning.str() );
+      break;
+    }
+    if ( subdevice < 0 )
+      break;
+    subdevices.push_back( subdevice );
+  }
+  snd_ctl_close( handle );
+}
+
+// Walks the cards and their devices once, in index order.  The cards
+// are walked on the probe threads, so a card whose control does not
+// answer within probeTimeout_ is left out instead of blocking.
+void RtApiAlsa :: mapDevices( DeviceMap &map )
+{
+  std::vector< std::pair<int, int> > cards;
+  int card = -1;
   snd_card_next( &card );
   while ( card >= 0 ) {
-    sprintf( name, "hw:%d", card );
-    result = snd_ctl_open( &handle, name, 0 );
-    if ( result < 0 ) {
-      errorStream_ << "RtApiAlsa::getDeviceCount: control open, card = " << card << ", " << snd_strerror( result ) << ".";
-      errorText_ = errorStream_.str();
+    cards.push_back( std::make_pair( card, -1 ) );
+    snd_card_next( &card );
+  }
+
+  AlsaProbe *probe = new AlsaProbe( cards, true );
+  runProbe( probe );
+  std::vector< std::vector<int> > subdevices;
+  std::vector< std::vector<std::string> > warnings;
+  subdevices.swap( probe->subdevices );
+  warnings.swap( probe->warnings );
+  probe->release();
+
+  map.clear();
+  for ( unsigned int i=0; i<cards.size(); i++ ) {
+    for ( unsigned int j=0; j<warnings[i].size(); j++ ) {
+      errorText_ = warnings[i][j];
       error( RtError::WARNING );
-      goto nextcard;
-    }
-    subdevice = -1;
-    while( 1 ) {
-      result = snd_ctl_pcm_next_device( handle, &subdevice );
-      if ( result < 0 ) {
-        errorStream_ << "RtApiAlsa::getDeviceCount: control next device, card = " << card << ", " << snd_strerror( result ) << ".";
-        errorText_ = errorStream_.str();
-        error( RtError::WARNING );
-        break;
-      }
-      if ( subdevice < 0 )
-        break;
-      nDevices++;
     }
-  nextcard:
-    snd_ctl_close( handle );
-    snd_card_next( &card );
+    for ( unsigned int j=0; j<subdevices[i].size(); j++ )
+      map.push_back( std::make_pair( cards[i].first, subdevices[i][j] ) );
   }
+}
 
-  return nDevices;
+RtApiAlsa::DeviceMap const &RtApiAlsa :: deviceMap( void )
+{
+  if ( !mapSaved_ ) {
+    mapDevices( map_ );
+    mapSaved_ = true;
+  }
+  return map_;
+}
+
+bool RtApiAlsa :: isStreamDevice( std::pair<int, int> const &id )
+{
+  if ( stream_.state == STREAM_CLOSED ) return false;
+  if ( stream_.mode != INPUT && streamIds_[0] == id ) return true;
+  if ( stream_.mode != OUTPUT && streamIds_[1] == id ) return true;
+  return false;
+}
+
+unsigned int RtApiAlsa :: getDeviceCount( void )
+{
+  return deviceMap().size();
 }
 
 RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
@@ -5153,44 +5472,8 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   RtAudio::DeviceInfo info;
   info.probed = false;
 
-  unsigned nDevices = 0;
-  int result, subdevice, card;
-  char name[64];
-  snd_ctl_t *chandle;
-
-  // Count cards and devices
-  card = -1;
-  snd_card_next( &card );
-  while ( card >= 0 ) {
-    sprintf( name, "hw:%d", card );
-    result = snd_ctl_open( &chandle, name, SND_CTL_NONBLOCK );
-    if ( result < 0 ) {
-      errorStream_ << "RtApiAlsa::getDeviceInfo: control open, card = " << card << ", " << snd_strerror( result ) << ".";
-      errorText_ = errorStream_.str();
-      error( RtError::WARNING );
-      goto nextcard;
-    }
-    subdevice = -1;
-    while( 1 ) {
-      result = snd_ctl_pcm_next_device( chandle, &subdevice );
-      if ( result < 0 ) {
-        errorStream_ << "RtApiAlsa::getDeviceInfo: control next device, card = " << card << ", " << snd_strerror( result ) << ".";
-        errorText_ = errorStream_.str();
-        error( RtError::WARNING );
-        break;
-      }
-      if ( subdevice < 0 ) break;
-      if ( nDevices == device ) {
-        sprintf( name, "hw:%d,%d", card, subdevice );
-        goto foundDevice;
-      }
-      nDevices++;
-    }
-  nextcard:
-    snd_ctl_close( chandle );
-    snd_card_next( &card );
-  }
-
+  DeviceMap const &map = deviceMap();
+  unsigned int nDevices = map.size();
   if ( nDevices == 0 ) {
     errorText_ = "RtApiAlsa::getDeviceInfo: no devices found!";
     error( RtError::INVALID_USE );
@@ -5201,20 +5484,36 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
     error( RtError::INVALID_USE );
   }
 
- foundDevice:
-
   // If a stream is already open, we cannot probe the stream devices.
-  // Thus, use the saved results.
-  if ( stream_.state != STREAM_CLOSED &&
-       ( stream_.device[0] == device || stream_.device[1] == device ) ) {
-    snd_ctl_close( chandle );
-    if ( device >= devices_.size() ) {
-      errorText_ = "RtApiAlsa::getDeviceInfo: device ID was not present before stream was opened.";
-      error( RtError::WARNING );
-      return info;
-    }
-    return devices_[ device ];
+  // Thus, use the saved results, which are looked up by card and
+  // subdevice since the device list may have been walked again.
+  if ( isStreamDevice( map[device] ) ) {
+    for ( unsigned int i=0; i<deviceIds_.size(); i++ )
+      if ( deviceIds_[i] == map[device] ) return devices_[i];
+    errorText_ = "RtApiAlsa::getDeviceInfo: device ID was not present before stream was opened.";
+    error( RtError::WARNING );
+    return info;
+  }
+
+  return probeDevices( map, std::vector<unsigned int>( 1, device ) )[0];
+}
+
+void RtApiAlsa :: probeDevice( int card, int subdevice, RtAudio::DeviceInfo &info,
+                               std::vector<std::string> &warnings )
+{
+  std::ostringstream warning;
+  int result;
+  char name[64];
+  snd_ctl_t *chandle;
+
+  sprintf( name, "hw:%d", card );
+  result = snd_ctl_open( &chandle, name, SND_CTL_NONBLOCK );
+  if ( result < 0 ) {
+    warning << "RtApiAlsa::getDeviceInfo: control open, card = " << card << ", " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    return;
   }
+  sprintf( name, "hw:%d,%d", card, subdevice );
 
   int openMode = SND_PCM_ASYNC;
   snd_pcm_stream_t stream;
@@ -5238,9 +5537,8 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
 
   result = snd_pcm_open( &phandle, name, stream, openMode | SND_PCM_NONBLOCK );
   if ( result < 0 ) {
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
     goto captureProbe;
   }
 
@@ -5248,9 +5546,8 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   result = snd_pcm_hw_params_any( phandle, params );
   if ( result < 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
     goto captureProbe;
   }
 
@@ -5259,9 +5556,8 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   result = snd_pcm_hw_params_get_channels_max( params, &value );
   if ( result < 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: error getting device (" << name << ") output channels, " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
+    warning << "RtApiAlsa::getDeviceInfo: error getting device (" << name << ") output channels, " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
     goto captureProbe;
   }
   info.outputChannels = value;
@@ -5269,6 +5565,7 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
 
  captureProbe:
   // Now try for capture
+  warning.str( "" );
   stream = SND_PCM_STREAM_CAPTURE;
   snd_pcm_info_set_stream( pcminfo, stream );
 
@@ -5276,16 +5573,15 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   snd_ctl_close( chandle );
   if ( result < 0 ) {
     // Device probably doesn't support capture.
-    if ( info.outputChannels == 0 ) return info;
+    if ( info.outputChannels == 0 ) return;
     goto probeParameters;
   }
 
   result = snd_pcm_open( &phandle, name, stream, openMode | SND_PCM_NONBLOCK);
   if ( result < 0 ) {
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    if ( info.outputChannels == 0 ) return info;
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    if ( info.outputChannels == 0 ) return;
     goto probeParameters;
   }
 
@@ -5293,20 +5589,18 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   result = snd_pcm_hw_params_any( phandle, params );
   if ( result < 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    if ( info.outputChannels == 0 ) return info;
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    if ( info.outputChannels == 0 ) return;
     goto probeParameters;
   }
 
   result = snd_pcm_hw_params_get_channels_max( params, &value );
   if ( result < 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: error getting device (" << name << ") input channels, " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    if ( info.outputChannels == 0 ) return info;
+    warning << "RtApiAlsa::getDeviceInfo: error getting device (" << name << ") input channels, " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    if ( info.outputChannels == 0 ) return;
     goto probeParameters;
   }
   info.inputChannels = value;
@@ -5316,18 +5610,13 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   if ( info.outputChannels > 0 && info.inputChannels > 0 )
     info.duplexChannels = (info.outputChannels > info.inputChannels) ? info.inputChannels : info.outputChannels;
 
-  // ALSA doesn't provide default devices so we'll use the first available one.
-  if ( device == 0 && info.outputChannels > 0 )
-    info.isDefaultOutput = true;
-  if ( device == 0 && info.inputChannels > 0 )
-    info.isDefaultInput = true;
-
  probeParameters:
   // At this point, we just need to figure out the supported data
   // formats and sample rates.  We'll proceed by opening the device in
   // the direction with the maximum number of channels, or playback if
   // they are equal.  This might limit our sample rate options, but so
   // be it.
+  warning.str( "" );
 
   if ( info.outputChannels >= info.inputChannels )
     stream = SND_PCM_STREAM_PLAYBACK;
@@ -5337,20 +5626,18 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
 
   result = snd_pcm_open( &phandle, name, stream, openMode | SND_PCM_NONBLOCK);
   if ( result < 0 ) {
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    return info;
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_open error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    return;
   }
 
   // The device is open ... fill the parameter structure.
   result = snd_pcm_hw_params_any( phandle, params );
   if ( result < 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    return info;
+    warning << "RtApiAlsa::getDeviceInfo: snd_pcm_hw_params error for device (" << name << "), " << snd_strerror( result ) << ".";
+    warnings.push_back( warning.str() );
+    return;
   }
 
   // Test our discrete set of sample rate values.
@@ -5361,10 +5648,9 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
   }
   if ( info.sampleRates.size() == 0 ) {
     snd_pcm_close( phandle );
-    errorStream_ << "RtApiAlsa::getDeviceInfo: no supported sample rates found for device (" << name << ").";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    return info;
+    warning << "RtApiAlsa::getDeviceInfo: no supported sample rates found for device (" << name << ").";
+    warnings.push_back( warning.str() );
+    return;
   }
 
   // Probe the supported data formats ... we don't care about endian-ness just yet
@@ -5391,33 +5677,155 @@ RtAudio::DeviceInfo RtApiAlsa :: getDeviceInfo( unsigned int device )
 
   // Check that we have at least one supported format
   if ( info.nativeFormats == 0 ) {
-    errorStream_ << "RtApiAlsa::getDeviceInfo: pcm device (" << name << ") data format not supported by RtAudio.";
-    errorText_ = errorStream_.str();
-    error( RtError::WARNING );
-    return info;
+    snd_pcm_close( phandle );
+    warning << "RtApiAlsa::getDeviceInfo: pcm device (" << name << ") data format not supported by RtAudio.";
+    warnings.push_back( warning.str() );
+    return;
   }
 
   // Get the device name
   char *cardname;
   result = snd_card_get_name( card, &cardname );
-  if ( result >= 0 )
+  if ( result >= 0 ) {
     sprintf( name, "hw:%s,%d", cardname, subdevice );
+    free( cardname );
+  }
   info.name = name;
 
   // That's all ... close the device and return
   snd_pcm_close( phandle );
   info.probed = true;
-  return info;
+}
+
+// Runs the probe concurrently on a few threads.  A device or card
+// whose probe runs longer than probeTimeout_ is abandoned, and its
+// thread is replaced so the others still get probed.  Returns with the
+// probe mutex held.
+void RtApiAlsa :: runProbe( AlsaProbe *probe )
+{
+  const unsigned int MAX_PROBE_THREADS = 4;
+
+  std::vector< std::pair<int, int> > const &ids = probe->ids;
+  unsigned int count = ids.size();
+  std::string caller = probe->walk ? "RtApiAlsa::mapDevices: " : "RtApiAlsa::getDeviceInfo: ";
+
+  pthread_mutex_lock( &probe->mutex );
+  for ( unsigned int i=0; i<count && i<MAX_PROBE_THREADS; i++ )
+    if ( !startAlsaProbeThread( probe ) ) break;
+
+  while ( probe->finished < count ) {
+    struct timespec now, deadline;
+    clock_gettime( CLOCK_REALTIME, &now );
+    deadline.tv_sec = 0;
+    for ( unsigned int i=0; i<count; i++ ) {
+      if ( probe->state[i] != AlsaProbe::RUNNING || probeTimeout_ <= 0 ) continue;
+      struct timespec limit = probe->started[i];
+      limit.tv_sec += (time_t) probeTimeout_;
+      limit.tv_nsec += (long) ( ( probeTimeout_ - (time_t) probeTimeout_ ) * 1000000000.0 );
+      if ( limit.tv_nsec >= 1000000000 ) {
+        limit.tv_sec++;
+        limit.tv_nsec -= 1000000000;
+      }
+      if ( now.tv_sec > limit.tv_sec || ( now.tv_sec == limit.tv_sec && now.tv_nsec >= limit.tv_nsec ) ) {
+        // Leave the thread stuck in the probe and carry on with another one.
+        std::ostringstream warning;
+        if ( probe->walk )
+          warning << caller << "card (hw:" << ids[i].first << ") did not answer within " << probeTimeout_ << " seconds.";
+        else
+          warning << caller << "device (hw:" << ids[i].first << "," << ids[i].second << ") did not answer within " << probeTimeout_ << " seconds.";
+        probe->warnings[i].push_back( warning.str() );
+        probe->state[i] = AlsaProbe::ABANDONED;
+        probe->finished++;
+        probe->workers--;
+        if ( probe->next < count ) startAlsaProbeThread( probe );
+        continue;
+      }
+      if ( deadline.tv_sec == 0 || limit.tv_sec < deadline.tv_sec ||
+           ( limit.tv_sec == deadline.tv_sec && limit.tv_nsec < deadline.tv_nsec ) )
+        deadline = limit;
+    }
+
+    if ( probe->finished == count ) break;
+    if ( probe->workers == 0 ) {
+      // No thread could be started, the rest goes unprobed.
+      for ( unsigned int i=probe->next; i<count; i++ ) {
+        probe->warnings[i].push_back( caller + "error creating a device probe thread." );
+        probe->state[i] = AlsaProbe::ABANDONED;
+        probe->finished++;
+      }
+      probe->next = count;
+      break;
+    }
+
+    if ( deadline.tv_sec )
+      pthread_cond_timedwait( &probe->done_cv, &probe->mutex, &deadline );
+    else
+      pthread_cond_wait( &probe->done_cv, &probe->mutex );
+  }
+}
+
+// Probes the given devices, see runProbe().
+std::vector<RtAudio::DeviceInfo> RtApiAlsa :: probeDevices( DeviceMap const &map,
+                                                           std::vector<unsigned int> const &devices )
+{
+  std::vector< std::pair<int, int> > ids( devices.size() );
+  for ( unsigned int i=0; i<devices.size(); i++ )
+    ids[i] = map[ devices[i] ];
+  AlsaProbe *probe = new AlsaProbe( ids, false );
+  runProbe( probe );
+
+  std::vector<RtAudio::DeviceInfo> infos;
+  std::vector< std::vector<std::string> > warnings;
+  infos.swap( probe->infos );
+  warnings.swap( probe->warnings );
+  probe->release();
+
+  for ( unsigned int i=0; i<devices.size(); i++ ) {
+    for ( unsigned int j=0; j<warnings[i].size(); j++ ) {
+      errorText_ = warnings[i][j];
+      error( RtError::WARNING );
+    }
+
+    // ALSA doesn't provide default devices so we'll use the first available one.
+    if ( devices[i] == 0 ) {
+      infos[i].isDefaultOutput = infos[i].outputChannels > 0;
+      infos[i].isDefaultInput = infos[i].inputChannels > 0;
+    }
+  }
+
+  return infos;
 }
 
 void RtApiAlsa :: saveDeviceInfo( void )
 {
-  devices_.clear();
+  // The devices of an open stream cannot be probed, their saved
+  // results are carried over, matched by card and subdevice.  The old
+  // list is kept until the new one is complete.
+  DeviceMap const &map = deviceMap();
+  unsigned int nDevices = map.size();
+  std::vector<unsigned int> probed;
+  std::vector<int> saved( nDevices, -1 );
+  for ( unsigned int i=0; i<nDevices; i++ ) {
+    if ( isStreamDevice( map[i] ) ) {
+      for ( unsigned int j=0; j<deviceIds_.size(); j++ )
+        if ( deviceIds_[j] == map[i] ) saved[i] = j;
+    }
+    if ( saved[i] < 0 ) probed.push_back( i );
+  }
+
+  std::vector<RtAudio::DeviceInfo> devices( nDevices );
+  std::vector<RtAudio::DeviceInfo> infos = probeDevices( map, probed );
+  for ( unsigned int i=0, j=0; i<nDevices; i++ )
+    devices[i] = ( saved[i] < 0 ) ? infos[j++] : devices_[ saved[i] ];
+  devices_.swap( devices );
+  deviceIds_ = map;
+  devicesSaved_ = true;
+}
 
-  unsigned int nDevices = getDeviceCount();
-  devices_.resize( nDevices );
-  for ( unsigned int i=0; i<nDevices; i++ )
-    devices_[i] = getDeviceInfo( i );
+std::vector<RtAudio::DeviceInfo> RtApiAlsa :: getAllDeviceInfo( void )
+{
+  if ( !devicesSaved_ ) saveDeviceInfo();
+  return devices_;
 }
 
 bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigned int channels,
@@ -5433,41 +5841,16 @@ bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigne
 
   // I'm not using the "plug" interface ... too much inconsistent behavior.
 
-  unsigned nDevices = 0;
-  int result, subdevice, card;
+  int result;
   char name[64];
-  snd_ctl_t *chandle;
 
-  if ( options && options->flags & RTAUDIO_ALSA_USE_DEFAULT )
+  if ( options && options->flags & RTAUDIO_ALSA_USE_DEFAULT ) {
     snprintf(name, sizeof(name), "%s", "default");
+    streamIds_[mode] = std::make_pair( -1, -1 );
+  }
   else {
-    // Count cards and devices
-    card = -1;
-    snd_card_next( &card );
-    while ( card >= 0 ) {
-      sprintf( name, "hw:%d", card );
-      result = snd_ctl_open( &chandle, name, SND_CTL_NONBLOCK );
-      if ( result < 0 ) {
-        errorStream_ << "RtApiAlsa::probeDeviceOpen: control open, card = " << card << ", " << snd_strerror( result ) << ".";
-        errorText_ = errorStream_.str();
-        return FAILURE;
-      }
-      subdevice = -1;
-      while( 1 ) {
-        result = snd_ctl_pcm_next_device( chandle, &subdevice );
-        if ( result < 0 ) break;
-        if ( subdevice < 0 ) break;
-        if ( nDevices == device ) {
-          sprintf( name, "hw:%d,%d", card, subdevice );
-          snd_ctl_close( chandle );
-          goto foundDevice;
-        }
-        nDevices++;
-      }
-      snd_ctl_close( chandle );
-      snd_card_next( &card );
-    }
-
+    DeviceMap const &map = deviceMap();
+    unsigned int nDevices = map.size();
     if ( nDevices == 0 ) {
       // This should not happen because a check is made before this function is called.
       errorText_ = "RtApiAlsa::probeDeviceOpen: no devices found!";
@@ -5479,10 +5862,10 @@ bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigne
       errorText_ = "RtApiAlsa::probeDeviceOpen: device ID is invalid!";
       return FAILURE;
     }
+    sprintf( name, "hw:%d,%d", map[device].first, map[device].second );
+    streamIds_[mode] = map[device];
   }
 
- foundDevice:
-
   // The getDeviceInfo() function will not work for a device that is
   // already open.  Thus, we'll probe the system before opening a
   // stream and save the results for use by getDeviceInfo().
@@ -5706,6 +6089,7 @@ bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigne
     errorText_ = errorStream_.str();
     return FAILURE;
   }
+  if ( options ) options->numberOfBuffers = periods;
 
   // If attempting to setup a duplex stream, the bufferSize parameter
   // MUST be the same in both directions!
@@ -5800,36 +6184,11 @@ bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigne
   phandle = 0;
 
   // Allocate necessary internal buffers.
-  unsigned long bufferBytes;
-  bufferBytes = stream_.nUserChannels[mode] * *bufferSize * formatBytes( stream_.userFormat );
-  stream_.userBuffer[mode] = (char *) calloc( bufferBytes, 1 );
-  if ( stream_.userBuffer[mode] == NULL ) {
-    errorText_ = "RtApiAlsa::probeDeviceOpen: error allocating user buffer memory.";
+  if ( !allocateStreamBuffers( options && options->flags & RTAUDIO_HUGE_PAGES ) ) {
+    errorText_ = "RtApiAlsa::probeDeviceOpen: error allocating stream buffer memory.";
     goto error;
   }
 
-  if ( stream_.doConvertBuffer[mode] ) {
-
-    bool makeBuffer = true;
-    bufferBytes = stream_.nDeviceChannels[mode] * formatBytes( stream_.deviceFormat[mode] );
-    if ( mode == INPUT ) {
-      if ( stream_.mode == OUTPUT && stream_.deviceBuffer ) {
-        unsigned long bytesOut = stream_.nDeviceChannels[0] * formatBytes( stream_.deviceFormat[0] );
-        if ( bufferBytes <= bytesOut ) makeBuffer = false;
-      }
-    }
-
-    if ( makeBuffer ) {
-      bufferBytes *= *bufferSize;
-      if ( stream_.deviceBuffer ) free( stream_.deviceBuffer );
-      stream_.deviceBuffer = (char *) calloc( bufferBytes, 1 );
-      if ( stream_.deviceBuffer == NULL ) {
-        errorText_ = "RtApiAlsa::probeDeviceOpen: error allocating device buffer memory.";
-        goto error;
-      }
-    }
-  }
-
   stream_.sampleRate = sampleRate;
   stream_.nBuffers = periods;
   stream_.device[mode] = device;
@@ -5907,17 +6266,7 @@ bool RtApiAlsa :: probeDeviceOpen( unsigned int device, StreamMode mode, unsigne
 
   if ( phandle) snd_pcm_close( phandle );
 
-  for ( int i=0; i<2; i++ ) {
-    if ( stream_.userBuffer[i] ) {
-      free( stream_.userBuffer[i] );
-      stream_.userBuffer[i] = 0;
-    }
-  }
-
-  if ( stream_.deviceBuffer ) {
-    free( stream_.deviceBuffer );
-    stream_.deviceBuffer = 0;
-  }
+  freeStreamBuffers();
 
   return FAILURE;
 }
@@ -5956,17 +6305,7 @@ void RtApiAlsa :: closeStream()
     stream_.apiHandle = 0;
   }
 
-  for ( int i=0; i<2; i++ ) {
-    if ( stream_.userBuffer[i] ) {
-      free( stream_.userBuffer[i] );
-      stream_.userBuffer[i] = 0;
-    }
-  }
-
-  if ( stream_.deviceBuffer ) {
-    free( stream_.deviceBuffer );
-    stream_.deviceBuffer = 0;
-  }
+  freeStreamBuffers();
 
   stream_.mode = UNINITIALIZED;
   stream_.state = STREAM_CLOSED;
@@ -6128,6 +6467,8 @@ void RtApiAlsa :: callbackEvent()
     return;
   }
 
+  trace( RTAUDIO_TRACE_WAKEUP, RTAUDIO_TRACE_INSTANT );
+
   int doStopStream = 0;
   RtAudioCallback callback = (RtAudioCallback) stream_.callbackInfo.callback;
   double streamTime = getStreamTime();
@@ -6140,14 +6481,20 @@ void RtApiAlsa :: callbackEvent()
     status |= RTAUDIO_INPUT_OVERFLOW;
     apiInfo->xrun[1] = false;
   }
+  trace( RTAUDIO_TRACE_CALLBACK, RTAUDIO_TRACE_BEGIN );
+  unsigned long long start = statsClock();
   doStopStream = callback( stream_.userBuffer[0], stream_.userBuffer[1],
                            stream_.bufferSize, streamTime, status, stream_.callbackInfo.userData );
+  unsigned long long busy = statsClock() - start;
+  trace( RTAUDIO_TRACE_CALLBACK, RTAUDIO_TRACE_END );
+  statsCallback( status, busy );
 
   if ( doStopStream == 2 ) {
     abortStream();
     return;
   }
 
+  unsigned long long convert = 0, device = 0;
   MUTEX_LOCK( &stream_.mutex );
 
   // The state might change while waiting on a mutex.
@@ -6176,6 +6523,8 @@ void RtApiAlsa :: callbackEvent()
     }
 
     // Read samples from device in interleaved/non-interleaved format.
+    trace( RTAUDIO_TRACE_READ, RTAUDIO_TRACE_BEGIN );
+    start = statsClock();
     if ( stream_.deviceInterleaved[1] )
       result = snd_pcm_readi( handle[1], buffer, stream_.bufferSize );
     else {
@@ -6185,12 +6534,15 @@ void RtApiAlsa :: callbackEvent()
         bufs[i] = (void *) (buffer + (i * offset));
       result = snd_pcm_readn( handle[1], bufs, stream_.bufferSize );
     }
+    device += statsClock() - start;
+    trace( RTAUDIO_TRACE_READ, RTAUDIO_TRACE_END );
 
     if ( result < (int) stream_.bufferSize ) {
       // Either an error or overrun occured.
       if ( result == -EPIPE ) {
         snd_pcm_state_t state = snd_pcm_state( handle[1] );
         if ( state == SND_PCM_STATE_XRUN ) {
+          trace( RTAUDIO_TRACE_OVERFLOW, RTAUDIO_TRACE_INSTANT );
           apiInfo->xrun[1] = true;
           result = snd_pcm_prepare( handle[1] );
           if ( result < 0 ) {
@@ -6211,13 +6563,20 @@ void RtApiAlsa :: callbackEvent()
       goto tryOutput;
     }
 
-    // Do byte swapping if necessary.
-    if ( stream_.doByteSwap[1] )
-      byteSwapBuffer( buffer, stream_.bufferSize * channels, format );
-
-    // Do buffer conversion if necessary.
-    if ( stream_.doConvertBuffer[1] )
-      convertBuffer( stream_.userBuffer[1], stream_.deviceBuffer, stream_.convertInfo[1] );
+    // Do byte swapping and buffer conversion if necessary, in one pass
+    // over the buffers when both are.
+    trace( RTAUDIO_TRACE_CONVERT, RTAUDIO_TRACE_BEGIN );
+    start = statsClock();
+    if ( stream_.doByteSwap[1] && stream_.doConvertBuffer[1] && stream_.convertInfo[1].swapPlan )
+      convertBuffer( stream_.userBuffer[1], stream_.deviceBuffer, stream_.convertInfo[1], true );
+    else {
+      if ( stream_.doByteSwap[1] )
+        byteSwapBuffer( buffer, stream_.bufferSize * channels, format );
+      if ( stream_.doConvertBuffer[1] )
+        convertBuffer( stream_.userBuffer[1], stream_.deviceBuffer, stream_.convertInfo[1] );
+    }
+    convert += statsClock() - start;
+    trace( RTAUDIO_TRACE_CONVERT, RTAUDIO_TRACE_END );
 
     // Check stream latency
     result = snd_pcm_delay( handle[1], &frames );
@@ -6229,9 +6588,14 @@ void RtApiAlsa :: callbackEvent()
   if ( stream_.mode == OUTPUT || stream_.mode == DUPLEX ) {
 
     // Setup parameters and do buffer conversion if necessary.
+    trace( RTAUDIO_TRACE_CONVERT, RTAUDIO_TRACE_BEGIN );
+    start = statsClock();
+    bool swapped = false;
     if ( stream_.doConvertBuffer[0] ) {
       buffer = stream_.deviceBuffer;
-      convertBuffer( buffer, stream_.userBuffer[0], stream_.convertInfo[0] );
+      // byte swapping, if necessary, in the same pass
+      swapped = stream_.doByteSwap[0] && stream_.convertInfo[0].swapPlan != 0;
+      convertBuffer( buffer, stream_.userBuffer[0], stream_.convertInfo[0], swapped );
       channels = stream_.nDeviceChannels[0];
       format = stream_.deviceFormat[0];
     }
@@ -6242,10 +6606,14 @@ void RtApiAlsa :: callbackEvent()
     }
 
     // Do byte swapping if necessary.
-    if ( stream_.doByteSwap[0] )
+    if ( stream_.doByteSwap[0] && !swapped )
       byteSwapBuffer(buffer, stream_.bufferSize * channels, format);
+    convert += statsClock() - start;
+    trace( RTAUDIO_TRACE_CONVERT, RTAUDIO_TRACE_END );
 
     // Write samples to device in interleaved/non-interleaved format.
+    trace( RTAUDIO_TRACE_WRITE, RTAUDIO_TRACE_BEGIN );
+    start = statsClock();
     if ( stream_.deviceInterleaved[0] )
       result = snd_pcm_writei( handle[0], buffer, stream_.bufferSize );
     else {
@@ -6255,12 +6623,15 @@ void RtApiAlsa :: callbackEvent()
         bufs[i] = (void *) (buffer + (i * offset));
       result = snd_pcm_writen( handle[0], bufs, stream_.bufferSize );
     }
+    device += statsClock() - start;
+    trace( RTAUDIO_TRACE_WRITE, RTAUDIO_TRACE_END );
 
     if ( result < (int) stream_.bufferSize ) {
       // Either an error or underrun occured.
       if ( result == -EPIPE ) {
         snd_pcm_state_t state = snd_pcm_state( handle[0] );
         if ( state == SND_PCM_STATE_XRUN ) {
+          trace( RTAUDIO_TRACE_UNDERFLOW, RTAUDIO_TRACE_INSTANT );
           apiInfo->xrun[0] = true;
           result = snd_pcm_prepare( handle[0] );
           if ( result < 0 ) {
@@ -6289,6 +6660,11 @@ void RtApiAlsa :: callbackEvent()
  unlock:
   MUTEX_UNLOCK( &stream_.mutex );
 
+  statsAdd( stats_.convertNanos, stats_.convertMax, convert );
+  statsAdd( stats_.deviceNanos, stats_.deviceMax, device );
+  busy += convert;
+  if ( busy > STATS_LOAD( stats_.busyMax ) ) STATS_STORE( stats_.busyMax, busy );
+
   RtApi::tickStreamTime();
   if ( doStopStream == 1 ) this->stopStream();
 }
@@ -7703,6 +8079,7 @@ void RtApi :: verifyStream()
 
 void RtApi :: clearStreamInfo()
 {
+  memset( &stats_, 0, sizeof( stats_ ) );
   stream_.mode = UNINITIALIZED;
   stream_.state = STREAM_CLOSED;
   stream_.sampleRate = 0;
@@ -7713,6 +8090,11 @@ void RtApi :: clearStreamInfo()
   stream_.streamTime = 0.0;
   stream_.apiHandle = 0;
   stream_.deviceBuffer = 0;
+  stream_.arena = 0;
+  stream_.arenaEntry = 0;
+  stream_.arenaBytes = 0;
+  stream_.arenaLocked = false;
+  stream_.arenaHugePages = false;
   stream_.callbackInfo.callback = 0;
   stream_.callbackInfo.userData = 0;
   stream_.callbackInfo.isRunning = false;
@@ -7734,7 +8116,286 @@ void RtApi :: clearStreamInfo()
     stream_.convertInfo[i].outFormat = 0;
     stream_.convertInfo[i].inOffset.clear();
     stream_.convertInfo[i].outOffset.clear();
+    stream_.convertInfo[i].plan = 0;
+    stream_.convertInfo[i].swapPlan = 0;
+  }
+}
+
+unsigned long RtApi :: userBufferBytes( int mode )
+{
+  return stream_.nUserChannels[mode] * stream_.bufferSize * formatBytes( stream_.userFormat );
+}
+
+unsigned long RtApi :: deviceBufferBytes( void )
+{
+  // One buffer serves both directions, sized for the larger.
+  unsigned long bytes = 0;
+  for ( int i=0; i<2; i++ ) {
+    if ( !stream_.doConvertBuffer[i] ) continue;
+    unsigned long direction = stream_.nDeviceChannels[i] * stream_.bufferSize * formatBytes( stream_.deviceFormat[i] );
+    if ( direction > bytes ) bytes = direction;
+  }
+  return bytes;
+}
+
+// The arenas of the open streams, and of closed ones while buffers lent
+// out of them by exchangeUserBuffer() are still held.  An arena goes away
+// with its last holder.
+struct StreamArena {
+  char *base;
+  unsigned long bytes;
+  bool locked;
+  long holders;            // see HOLDERS_ADD
+  StreamArena *next;
+};
+
+static StreamArena *arenas = 0;
+
+struct ArenaLock {
+  StreamMutex mutex;
+  ArenaLock() { MUTEX_INITIALIZE( &mutex ); }
+};
+
+static ArenaLock arenaLock;
+
+// Maps bytes rounded up to whole pages, faults them in by zeroing them,
+// and locks them if the memory limit allows.  Returns 0 when out of
+// memory.
+static char *mapArena( unsigned long &bytes, bool &locked )
+{
+#if defined(__WINDOWS_DS__) || defined(__WINDOWS_ASIO__)
+  // Large pages need a privilege few accounts have, regular ones are used.
+  char *base = (char *) VirtualAlloc( NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+  if ( base == NULL ) return 0;
+  memset( base, 0, bytes );
+  locked = VirtualLock( base, bytes ) != 0;
+#else
+  unsigned long page = sysconf( _SC_PAGESIZE );
+  bytes = ( bytes + page - 1 ) / page * page;
+  void *memory = mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0 );
+  if ( memory == MAP_FAILED ) return 0;
+  char *base = (char *) memory;
+  memset( base, 0, bytes );
+  locked = mlock( base, bytes ) == 0;
+#endif
+  return base;
+}
+
+static void unmapArena( char *base, unsigned long bytes )
+{
+#if defined(__WINDOWS_DS__) || defined(__WINDOWS_ASIO__)
+  VirtualFree( base, 0, MEM_RELEASE );
+#else
+  munmap( base, bytes );
+#endif
+}
+
+static void listArena( StreamArena *entry )
+{
+  MUTEX_LOCK( &arenaLock.mutex );
+  entry->next = arenas;
+  arenas = entry;
+  MUTEX_UNLOCK( &arenaLock.mutex );
+}
+
+// Called from the callback thread, so it takes no lock.  The open
+// stream is a holder itself, thus the count cannot drop to zero
+// meanwhile.
+static void holdArena( void *entry )
+{
+  HOLDERS_ADD( ( (StreamArena *) entry )->holders );
+}
+
+static void dropArena( StreamArena *entry )
+{
+  if ( HOLDERS_SUB( entry->holders ) != 0 ) return;
+
+  MUTEX_LOCK( &arenaLock.mutex );
+  for ( StreamArena **arena = &arenas; *arena; arena = &(*arena)->next ) {
+    if ( *arena != entry ) continue;
+    *arena = entry->next;
+    break;
+  }
+  MUTEX_UNLOCK( &arenaLock.mutex );
+  unmapArena( entry->base, entry->bytes );
+  delete entry;
+}
+
+// Returns false when buffer is not in an arena.  The caller holds the
+// arena through buffer, so it stays listed until dropped here.
+static bool releaseArena( char *buffer )
+{
+  StreamArena *found = 0;
+  MUTEX_LOCK( &arenaLock.mutex );
+  for ( StreamArena *arena = arenas; arena; arena = arena->next ) {
+    if ( buffer < arena->base || buffer >= arena->base + arena->bytes ) continue;
+    found = arena;
+    break;
+  }
+  MUTEX_UNLOCK( &arenaLock.mutex );
+
+  if ( !found ) return false;
+  dropArena( found );
+  return true;
+}
+
+// A buffer of its own is listed as an arena with the caller as its one
+// holder, so freeUserBuffer() unmaps it.
+char *RtAudio :: allocateUserBuffer( unsigned long bytes ) throw()
+{
+  StreamArena *entry = 0;
+  try {
+    entry = new StreamArena;
+  }
+  catch ( std::bad_alloc& ) {
+    return 0;
+  }
+
+  bool locked = false;
+  char *buffer = mapArena( bytes, locked );
+  if ( buffer == 0 ) {
+    delete entry;
+    return 0;
+  }
+  entry->base = buffer;
+  entry->bytes = bytes;
+  entry->locked = locked;
+  entry->holders = 1;
+  listArena( entry );
+  return buffer;
+}
+
+// Adds the bytes of the arena buffer starts, if any, and returns whether
+// it is locked.  Entries are unlisted under the lock before being deleted.
+static bool lookupArena( char *buffer, unsigned long &bytes )
+{
+  bool locked = false;
+  MUTEX_LOCK( &arenaLock.mutex );
+  for ( StreamArena *arena = arenas; arena; arena = arena->next ) {
+    if ( arena->base != buffer ) continue;
+    bytes += arena->bytes;
+    locked = arena->locked;
+    break;
+  }
+  MUTEX_UNLOCK( &arenaLock.mutex );
+  return locked;
+}
+
+void RtAudio :: freeUserBuffer( char *buffer ) throw()
+{
+  if ( buffer && !releaseArena( buffer ) ) free( buffer );
+}
+
+#if defined(MAP_HUGETLB)
+// The size MAP_HUGETLB maps in, which varies by architecture and boot
+// options, or 0 when the kernel does not tell.
+static unsigned long hugePageSize( void )
+{
+  unsigned long kiB = 0;
+  FILE *meminfo = fopen( "/proc/meminfo", "r" );
+  if ( meminfo == NULL ) return 0;
+  char line[128];
+  while ( fgets( line, sizeof(line), meminfo ) ) {
+    if ( sscanf( line, "Hugepagesize: %lu kB", &kiB ) == 1 ) break;
+    kiB = 0;
+  }
+  fclose( meminfo );
+  return kiB * 1024;
+}
+#endif
+
+// The buffers are laid out one after the other, each starting on a cache
+// line.  The arena is written to once so that its pages are faulted in
+// here rather than in the first callbacks, then locked if the memory
+// limit allows.  When the second direction of a duplex stream opens, the
+// arena is made anew for both.
+bool RtApi :: allocateStreamBuffers( bool hugePages )
+{
+  const unsigned long line = 64;
+  unsigned long sizes[3], total = 0;
+  for ( int i=0; i<2; i++ )
+    sizes[i] = stream_.nUserChannels[i] ? userBufferBytes( i ) : 0;
+  sizes[2] = deviceBufferBytes();
+  for ( int i=0; i<3; i++ )
+    total += ( sizes[i] + line - 1 ) / line * line;
+
+  freeStreamBuffers();
+  if ( total == 0 ) return true;
+
+  StreamArena *entry = 0;
+  try {
+    entry = new StreamArena;
+  }
+  catch ( std::bad_alloc& ) {
+    return false;
+  }
+
+  char *arena = 0;
+  unsigned long bytes = 0;
+  bool locked = false, huge = false;
+#if defined(MAP_HUGETLB)
+  // The length is rounded to the huge page size, or munmap() fails.
+  const unsigned long hugePage = hugePages ? hugePageSize() : 0;
+  if ( hugePage ) {
+    bytes = ( total + hugePage - 1 ) / hugePage * hugePage;
+    void *memory = mmap( NULL, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0 );
+    if ( memory != MAP_FAILED ) {
+      arena = (char *) memory;
+      huge = true;
+      memset( arena, 0, bytes );
+      locked = mlock( arena, bytes ) == 0;
+    }
+  }
+#endif
+  if ( arena == 0 ) {
+    bytes = total;
+    arena = mapArena( bytes, locked );
+    if ( arena == 0 ) {
+      delete entry;
+      return false;
+    }
+  }
+
+  entry->base = arena;
+  entry->bytes = bytes;
+  entry->locked = locked;
+  entry->holders = 1;
+  listArena( entry );
+
+  stream_.arena = arena;
+  stream_.arenaEntry = entry;
+  stream_.arenaBytes = bytes;
+  stream_.arenaLocked = locked;
+  stream_.arenaHugePages = huge;
+  char *next = arena;
+  for ( int i=0; i<2; i++ ) {
+    if ( sizes[i] ) stream_.userBuffer[i] = next;
+    next += ( sizes[i] + line - 1 ) / line * line;
   }
+  if ( sizes[2] ) stream_.deviceBuffer = next;
+  return true;
+}
+
+void RtApi :: freeStreamBuffers( void )
+{
+  // Buffers exchanged in were allocated one by one.
+  char *arena = stream_.arena;
+  for ( int i=0; i<2; i++ ) {
+    char *buffer = stream_.userBuffer[i];
+    if ( buffer && !( arena && buffer >= arena && buffer < arena + stream_.arenaBytes ) )
+      RtAudio::freeUserBuffer( buffer );
+    stream_.userBuffer[i] = 0;
+  }
+  if ( stream_.deviceBuffer && !arena ) free( stream_.deviceBuffer );
+  stream_.deviceBuffer = 0;
+
+  if ( stream_.arenaEntry ) dropArena( (StreamArena *) stream_.arenaEntry );
+  stream_.arena = 0;
+  stream_.arenaEntry = 0;
+  stream_.arenaBytes = 0;
+  stream_.arenaLocked = false;
+  stream_.arenaHugePages = false;
 }
 
 unsigned int RtApi :: formatBytes( RtAudioFormat format )
@@ -7755,6 +8416,16 @@ unsigned int RtApi :: formatBytes( RtAudioFormat format )
   return 0;
 }
 
+// The conversion plans, see setConvertInfo(); they are defined with the
+// conversion loops further down.  A plan may also byte-swap the device
+// samples it reads or writes.
+enum PlanSwap { PLAN_SWAP_NONE, PLAN_SWAP_IN, PLAN_SWAP_OUT };
+typedef void (*ConversionPlan)( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                                int outJump, int inJump );
+static ConversionPlan selectConversionPlan( RtAudioFormat outFormat, RtAudioFormat inFormat, bool dense,
+                                            int channels, bool outPlanar, bool inPlanar, PlanSwap swap,
+                                            bool blocks );
+
 void RtApi :: setConvertInfo( StreamMode mode, unsigned int firstChannel )
 {
   if ( mode == INPUT ) { // convert device to user buffer
@@ -7833,9 +8504,789 @@ void RtApi :: setConvertInfo( StreamMode mode, unsigned int firstChannel )
       }
     }
   }
+
+  // Without channel offsets, channel compensation or (de)interleaving the
+  // conversion is one flat run of samples, which convertBuffer() handles
+  // without the per-sample offset lookups.
+  ConvertInfo &info = stream_.convertInfo[mode];
+  info.dense = ( info.inJump == info.outJump && info.inOffset == info.outOffset );
+  for ( int k=0; info.dense && k<info.channels; k++ ) {
+    if ( info.inJump == info.channels )
+      info.dense = ( info.inOffset[k] == k );
+    else
+      info.dense = ( info.inJump == 1 && info.inOffset[k] == (int) ( k * stream_.bufferSize ) );
+  }
+
+  // Pick the conversion loop now, so that convertBuffer() neither branches
+  // on the formats nor looks up the channel offsets for every sample.  The
+  // loops assume the channels of a buffer are evenly spaced, one sample
+  // apart when it is interleaved and one buffer apart when it is not, which
+  // the offsets above always are; otherwise the general loops still run.
+  bool inPlanar = ( mode == INPUT ) ? !stream_.deviceInterleaved[mode] : !stream_.userInterleaved;
+  bool outPlanar = ( mode == INPUT ) ? !stream_.userInterleaved : !stream_.deviceInterleaved[mode];
+  int inStride = inPlanar ? stream_.bufferSize : 1;
+  int outStride = outPlanar ? stream_.bufferSize : 1;
+  bool even = ( info.channels > 0 );
+  for ( int k=1; even && k<info.channels; k++ )
+    even = ( info.inOffset[k] == info.inOffset[0] + k * inStride &&
+             info.outOffset[k] == info.outOffset[0] + k * outStride );
+  info.plan = 0;
+  info.swapPlan = 0;
+  if ( even ) {
+    // The byte-swapping plan swaps whole device frames a block at a time when
+    // the device samples are interleaved and no channel offset shifts them.
+    bool blocks = ( mode == INPUT ) ? ( !inPlanar && info.inOffset[0] == 0 )
+                                    : ( !outPlanar && info.outOffset[0] == 0 );
+    info.plan = selectConversionPlan( info.outFormat, info.inFormat, info.dense, info.channels,
+                                      outPlanar, inPlanar, PLAN_SWAP_NONE, false );
+    info.swapPlan = selectConversionPlan( info.outFormat, info.inFormat, info.dense, info.channels,
+                                          outPlanar, inPlanar, ( mode == INPUT ) ? PLAN_SWAP_IN : PLAN_SWAP_OUT,
+                                          blocks );
+    info.inStart = info.inOffset[0] * formatBytes( info.inFormat );
+    info.outStart = info.outOffset[0] * formatBytes( info.outFormat );
+  }
+}
+
+// The dense conversion loops. They work on plain contiguous arrays, so the
+// compiler can vectorize them, and use the same arithmetic as the general
+// loops in convertBuffer() so the results are bit-identical.  They are
+// inlined into each kernel that uses them, so the scalar kernels (see
+// kernelVariants) can be built with the vectorizer turned off.
+#if defined(__GNUC__) && !defined(__clang__) && ( defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) )
+#define RTAUDIO_INLINE_LOOP inline __attribute__((always_inline))
+#define RTAUDIO_NO_VECTORIZE __attribute__((optimize( "no-tree-vectorize" )))
+#else
+#define RTAUDIO_INLINE_LOOP inline
+#define RTAUDIO_NO_VECTORIZE
+#endif
+
+template <typename Out, typename In>
+static RTAUDIO_INLINE_LOOP void convertIntToFloat( Out * __restrict out, const In * __restrict in,
+                                                   unsigned int samples, Out scale, int mask )
+{
+  for ( unsigned int i=0; i<samples; i++ ) {
+    Out value = (Out) ( in[i] & mask );
+    value += 0.5;
+    value *= scale;
+    out[i] = value;
+  }
+}
+
+template <typename Out, typename In>
+static RTAUDIO_INLINE_LOOP void convertFloatToInt( Out * __restrict out, const In * __restrict in,
+                                                   unsigned int samples, double factor )
+{
+  for ( unsigned int i=0; i<samples; i++ )
+    out[i] = (Out) ( in[i] * factor - 0.5 );
+}
+
+template <typename Out, typename In>
+static RTAUDIO_INLINE_LOOP void convertFloatToFloat( Out * __restrict out, const In * __restrict in, unsigned int samples )
+{
+  for ( unsigned int i=0; i<samples; i++ )
+    out[i] = (Out) in[i];
+}
+
+// Returns false for the format pairs it does not cover.
+static RTAUDIO_INLINE_LOOP bool convertDenseLoops( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                                   RtAudioFormat inFormat, unsigned int samples )
+{
+  if ( outFormat == RTAUDIO_FLOAT32 || outFormat == RTAUDIO_FLOAT64 ) {
+    bool single = ( outFormat == RTAUDIO_FLOAT32 );
+    float *out32 = (float *) outBuffer;
+    double *out64 = (double *) outBuffer;
+    switch ( inFormat ) {
+    case RTAUDIO_SINT8:
+      if ( single ) convertIntToFloat( out32, (signed char *) inBuffer, samples, (float) ( 1.0 / 127.5 ), ~0 );
+      else convertIntToFloat( out64, (signed char *) inBuffer, samples, 1.0 / 127.5, ~0 );
+      return true;
+    case RTAUDIO_SINT16:
+      if ( single ) convertIntToFloat( out32, (short *) inBuffer, samples, (float) ( 1.0 / 32767.5 ), ~0 );
+      else convertIntToFloat( out64, (short *) inBuffer, samples, 1.0 / 32767.5, ~0 );
+      return true;
+    case RTAUDIO_SINT24:
+      if ( single ) convertIntToFloat( out32, (int *) inBuffer, samples, (float) ( 1.0 / 8388607.5 ), 0x00ffffff );
+      else convertIntToFloat( out64, (int *) inBuffer, samples, 1.0 / 8388607.5, 0x00ffffff );
+      return true;
+    case RTAUDIO_SINT32:
+      if ( single ) convertIntToFloat( out32, (int *) inBuffer, samples, (float) ( 1.0 / 2147483647.5 ), ~0 );
+      else convertIntToFloat( out64, (int *) inBuffer, samples, 1.0 / 2147483647.5, ~0 );
+      return true;
+    case RTAUDIO_FLOAT32:
+      if ( single ) memcpy( outBuffer, inBuffer, samples * sizeof( float ) );
+      else convertFloatToFloat( out64, (float *) inBuffer, samples );
+      return true;
+    case RTAUDIO_FLOAT64:
+      if ( single ) convertFloatToFloat( out32, (double *) inBuffer, samples );
+      else memcpy( outBuffer, inBuffer, samples * sizeof( double ) );
+      return true;
+    }
+    return false;
+  }
+
+  if ( inFormat != RTAUDIO_FLOAT32 && inFormat != RTAUDIO_FLOAT64 ) return false;
+  bool single = ( inFormat == RTAUDIO_FLOAT32 );
+  float *in32 = (float *) inBuffer;
+  double *in64 = (double *) inBuffer;
+  switch ( outFormat ) {
+  case RTAUDIO_SINT8:
+    if ( single ) convertFloatToInt( (signed char *) outBuffer, in32, samples, 127.5 );
+    else convertFloatToInt( (signed char *) outBuffer, in64, samples, 127.5 );
+    return true;
+  case RTAUDIO_SINT16:
+    if ( single ) convertFloatToInt( (short *) outBuffer, in32, samples, 32767.5 );
+    else convertFloatToInt( (short *) outBuffer, in64, samples, 32767.5 );
+    return true;
+  case RTAUDIO_SINT24:
+    if ( single ) convertFloatToInt( (int *) outBuffer, in32, samples, 8388607.5 );
+    else convertFloatToInt( (int *) outBuffer, in64, samples, 8388607.5 );
+    return true;
+  case RTAUDIO_SINT32:
+    if ( single ) convertFloatToInt( (int *) outBuffer, in32, samples, 2147483647.5 );
+    else convertFloatToInt( (int *) outBuffer, in64, samples, 2147483647.5 );
+    return true;
+  }
+  return false;
+}
+
+// As the compiler vectorizes them for the baseline instruction set.
+static bool convertDenseBuffer( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                RtAudioFormat inFormat, unsigned int samples )
+{
+  return convertDenseLoops( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+RTAUDIO_NO_VECTORIZE
+static bool convertDenseScalar( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                RtAudioFormat inFormat, unsigned int samples )
+{
+  return convertDenseLoops( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+static inline unsigned int swapWordBytes( unsigned int word )
+{
+  return ( word >> 24 ) | ( ( word >> 8 ) & 0x0000ff00 ) | ( ( word << 8 ) & 0x00ff0000 ) | ( word << 24 );
+}
+
+// Byte-swaps samples of the given size, in place when outBuffer is inBuffer.
+// Also the tail of the vector kernels.
+RTAUDIO_NO_VECTORIZE
+static void byteSwapScalar( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  if ( bytes == 2 ) {
+    unsigned short *out = (unsigned short *) outBuffer;
+    unsigned short *in = (unsigned short *) inBuffer;
+    for ( unsigned int i=0; i<samples; i++ )
+      out[i] = (unsigned short) ( ( in[i] >> 8 ) | ( in[i] << 8 ) );
+  }
+  else if ( bytes == 4 ) {
+    unsigned int *out = (unsigned int *) outBuffer;
+    unsigned int *in = (unsigned int *) inBuffer;
+    for ( unsigned int i=0; i<samples; i++ )
+      out[i] = swapWordBytes( in[i] );
+  }
+  else if ( bytes == 8 ) {
+    // both 32-bit halves swapped, and the halves exchanged
+    unsigned int *out = (unsigned int *) outBuffer;
+    unsigned int *in = (unsigned int *) inBuffer;
+    for ( unsigned int i=0; i<samples; i++ ) {
+      unsigned int low = in[2*i], high = in[2*i+1];
+      out[2*i] = swapWordBytes( high );
+      out[2*i+1] = swapWordBytes( low );
+    }
+  }
+}
+
+// Explicitly vectorized forms of the dense loops for the pairs that carry
+// most streams: 16, 24 and 32-bit integers to and from 32 and 64-bit
+// floats.  They are written once over GCC vector types of W lanes and
+// built for several instruction sets; the widest one the CPU supports is
+// picked when the library is loaded.  Every lane does what the scalar loop
+// does for one sample: integers become floats rounding to nearest, floats
+// become integers truncating, and the +0.5/-0.5 and scale steps are kept
+// in the same order and precision, so the results are bit-identical.
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) )
+#define RTAUDIO_SIMD_CONVERT
+
+// The x86 variants must not fuse the multiply and subtract of the float to
+// integer conversions (AVX-512 implies FMA), the scalar loops do not
+// either.  On ARM, FMA is always available and the compiler fuses both alike.
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC optimize ( "fp-contract=off" )
+#endif
+
+// A vector of W samples of type T.
+template <typename T, int W>
+struct SimdVector {
+  typedef T Type __attribute__((vector_size( W * sizeof( T ) )));
+};
+
+template <int W, typename Out, typename In>
+static inline __attribute__((always_inline))
+void simdIntToFloat( Out *out, const In *in, unsigned int samples, Out scale, int mask )
+{
+  typedef typename SimdVector<In, W>::Type InVector;
+  typedef typename SimdVector<int, W>::Type IntVector;
+  typedef typename SimdVector<Out, W>::Type OutVector;
+
+  unsigned int i = 0;
+  for ( ; i + W <= samples; i += W ) {
+    InVector samplesIn;
+    memcpy( &samplesIn, in + i, sizeof( samplesIn ) );
+    IntVector value = __builtin_convertvector( samplesIn, IntVector ) & mask;
+    OutVector result = __builtin_convertvector( value, OutVector );
+    result += (Out) 0.5;
+    result *= scale;
+    memcpy( out + i, &result, sizeof( result ) );
+  }
+  convertIntToFloat( out + i, in + i, samples - i, scale, mask );
+}
+
+template <int W, typename Out, typename In>
+static inline __attribute__((always_inline))
+void simdFloatToInt( Out *out, const In *in, unsigned int samples, double factor )
+{
+  typedef typename SimdVector<In, W>::Type InVector;
+  typedef typename SimdVector<double, W>::Type DoubleVector;
+  typedef typename SimdVector<int, W>::Type IntVector;
+  typedef typename SimdVector<Out, W>::Type OutVector;
+
+  unsigned int i = 0;
+  for ( ; i + W <= samples; i += W ) {
+    InVector samplesIn;
+    memcpy( &samplesIn, in + i, sizeof( samplesIn ) );
+    DoubleVector value = __builtin_convertvector( samplesIn, DoubleVector ) * factor - 0.5;
+    // Through int like the scalar cast, so 16-bit results wrap the same way.
+    IntVector truncated = __builtin_convertvector( value, IntVector );
+    OutVector result = __builtin_convertvector( truncated, OutVector );
+    memcpy( out + i, &result, sizeof( result ) );
+  }
+  convertFloatToInt( out + i, in + i, samples - i, factor );
+}
+
+template <int W>
+static inline __attribute__((always_inline))
+bool convertDenseSimd( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                       RtAudioFormat inFormat, unsigned int samples )
+{
+  if ( outFormat == RTAUDIO_FLOAT32 || outFormat == RTAUDIO_FLOAT64 ) {
+    bool single = ( outFormat == RTAUDIO_FLOAT32 );
+    float *out32 = (float *) outBuffer;
+    double *out64 = (double *) outBuffer;
+    switch ( inFormat ) {
+    case RTAUDIO_SINT16:
+      if ( single ) simdIntToFloat<W>( out32, (short *) inBuffer, samples, (float) ( 1.0 / 32767.5 ), ~0 );
+      else simdIntToFloat<W>( out64, (short *) inBuffer, samples, 1.0 / 32767.5, ~0 );
+      return true;
+    case RTAUDIO_SINT24:
+      if ( single ) simdIntToFloat<W>( out32, (int *) inBuffer, samples, (float) ( 1.0 / 8388607.5 ), 0x00ffffff );
+      else simdIntToFloat<W>( out64, (int *) inBuffer, samples, 1.0 / 8388607.5, 0x00ffffff );
+      return true;
+    case RTAUDIO_SINT32:
+      if ( single ) simdIntToFloat<W>( out32, (int *) inBuffer, samples, (float) ( 1.0 / 2147483647.5 ), ~0 );
+      else simdIntToFloat<W>( out64, (int *) inBuffer, samples, 1.0 / 2147483647.5, ~0 );
+      return true;
+    }
+  }
+  else if ( inFormat == RTAUDIO_FLOAT32 || inFormat == RTAUDIO_FLOAT64 ) {
+    bool single = ( inFormat == RTAUDIO_FLOAT32 );
+    float *in32 = (float *) inBuffer;
+    double *in64 = (double *) inBuffer;
+    switch ( outFormat ) {
+    case RTAUDIO_SINT16:
+      if ( single ) simdFloatToInt<W>( (short *) outBuffer, in32, samples, 32767.5 );
+      else simdFloatToInt<W>( (short *) outBuffer, in64, samples, 32767.5 );
+      return true;
+    case RTAUDIO_SINT24:
+      if ( single ) simdFloatToInt<W>( (int *) outBuffer, in32, samples, 8388607.5 );
+      else simdFloatToInt<W>( (int *) outBuffer, in64, samples, 8388607.5 );
+      return true;
+    case RTAUDIO_SINT32:
+      if ( single ) simdFloatToInt<W>( (int *) outBuffer, in32, samples, 2147483647.5 );
+      else simdFloatToInt<W>( (int *) outBuffer, in64, samples, 2147483647.5 );
+      return true;
+    }
+  }
+
+  // 8-bit samples and float to float copies stay with the scalar loops.
+  return convertDenseBuffer( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+// The byte swap as one byte shuffle per vector of W bytes (pshufb on x86,
+// rev or tbl on ARM).  __builtin_shuffle is GCC's own, clang keeps the
+// scalar swap.
+#if !defined(__clang__)
+#define RTAUDIO_SIMD_SWAP
+
+template <int W, int Bytes>
+static inline __attribute__((always_inline))
+void byteSwapSimd( char *outBuffer, char *inBuffer, unsigned int samples )
+{
+  typedef typename SimdVector<char, W>::Type ByteVector;
+  ByteVector order;
+  for ( int k=0; k<W; k++ )
+    order[k] = (char) ( k - k % Bytes + Bytes - 1 - k % Bytes );
+
+  unsigned int bytes = samples * Bytes, i = 0;
+  for ( ; i + W <= bytes; i += W ) {
+    ByteVector v;
+    memcpy( &v, inBuffer + i, W );
+    v = __builtin_shuffle( v, order );
+    memcpy( outBuffer + i, &v, W );
+  }
+  byteSwapScalar( outBuffer + i, inBuffer + i, ( bytes - i ) / Bytes, Bytes );
+}
+
+template <int W>
+static inline __attribute__((always_inline))
+void byteSwapSimd( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  if ( bytes == 2 ) byteSwapSimd<W, 2>( outBuffer, inBuffer, samples );
+  else if ( bytes == 4 ) byteSwapSimd<W, 4>( outBuffer, inBuffer, samples );
+  else if ( bytes == 8 ) byteSwapSimd<W, 8>( outBuffer, inBuffer, samples );
+}
+
+// SSE2 has no byte shuffle.  There the bytes of each 16-bit lane are
+// swapped with shifts, and the lanes of a sample reversed with a 16-bit
+// shuffle.
+template <int W, int Bytes>
+static inline __attribute__((always_inline))
+void byteSwapShifts( char *outBuffer, char *inBuffer, unsigned int samples )
+{
+  typedef typename SimdVector<unsigned short, W / 2>::Type HalfVector;
+  typedef typename SimdVector<short, W / 2>::Type IndexVector;
+  const int halves = Bytes / 2;
+  IndexVector order;
+  for ( int k=0; k<W / 2; k++ )
+    order[k] = (short) ( k - k % halves + halves - 1 - k % halves );
+
+  unsigned int bytes = samples * Bytes, i = 0;
+  for ( ; i + W <= bytes; i += W ) {
+    HalfVector v;
+    memcpy( &v, inBuffer + i, W );
+    v = ( v >> 8 ) | ( v << 8 );
+    if ( halves > 1 ) v = __builtin_shuffle( v, order );
+    memcpy( outBuffer + i, &v, W );
+  }
+  byteSwapScalar( outBuffer + i, inBuffer + i, ( bytes - i ) / Bytes, Bytes );
+}
+
+template <int W>
+static inline __attribute__((always_inline))
+void byteSwapShifts( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  if ( bytes == 2 ) byteSwapShifts<W, 2>( outBuffer, inBuffer, samples );
+  else if ( bytes == 4 ) byteSwapShifts<W, 4>( outBuffer, inBuffer, samples );
+  else if ( bytes == 8 ) byteSwapShifts<W, 8>( outBuffer, inBuffer, samples );
+}
+#endif
+
+// The SSE2 baseline of x86-64 is served as well by the compiler's own
+// vectorization of the scalar conversion loops, only the wider units get
+// conversion kernels.  The byte swap has none to fall back on.
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static bool convertDenseAvx2( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                              RtAudioFormat inFormat, unsigned int samples )
+{
+  return convertDenseSimd<8>( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+__attribute__((target("avx512f")))
+static bool convertDenseAvx512( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                RtAudioFormat inFormat, unsigned int samples )
+{
+  return convertDenseSimd<16>( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+#if defined(RTAUDIO_SIMD_SWAP)
+#if defined(__SSE2__)
+static void byteSwapSse2( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  byteSwapShifts<16>( outBuffer, inBuffer, samples, bytes );
+}
+#endif
+
+__attribute__((target("avx2")))
+static void byteSwapAvx2( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  byteSwapSimd<32>( outBuffer, inBuffer, samples, bytes );
+}
+
+__attribute__((target("avx512bw")))
+static void byteSwapAvx512( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  byteSwapSimd<64>( outBuffer, inBuffer, samples, bytes );
+}
+#endif
+
+#pragma GCC pop_options
+#else
+static bool convertDenseNeon( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                              RtAudioFormat inFormat, unsigned int samples )
+{
+  return convertDenseSimd<4>( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+#if defined(RTAUDIO_SIMD_SWAP)
+static void byteSwapNeon( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  byteSwapSimd<16>( outBuffer, inBuffer, samples, bytes );
+}
+#endif
+#endif
+
+#endif // RTAUDIO_SIMD_CONVERT
+
+typedef bool (*DenseConverter)( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                RtAudioFormat inFormat, unsigned int samples );
+typedef void (*ByteSwapper)( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes );
+
+// The kernels behind convertBuffer() and byteSwapBuffer(), one set per
+// instruction set, the fastest first.  The conversion plans reach them
+// through the active set, so a stream picks up a change of set with its
+// next buffer.  All sets give the same samples, bit for bit.  Where the
+// compiler has no vector kernel to offer, its own vectorization of the
+// scalar loops stands in, and the scalar set is that.
+struct KernelVariant {
+  const char *name;
+  bool (*supported)( void );  // NULL when every CPU the build runs on has it
+  DenseConverter convertDense;
+  ByteSwapper byteSwap;
+};
+
+#if defined(RTAUDIO_SIMD_CONVERT) && ( defined(__x86_64__) || defined(__i386__) )
+static bool cpuHasAvx512( void )
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" );
+}
+
+static bool cpuHasAvx2( void )
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports( "avx2" );
+}
+#endif
+
+static const KernelVariant kernelVariants[] = {
+#if defined(RTAUDIO_SIMD_CONVERT) && ( defined(__x86_64__) || defined(__i386__) )
+#if defined(RTAUDIO_SIMD_SWAP)
+  { "avx512", cpuHasAvx512, convertDenseAvx512, byteSwapAvx512 },
+  { "avx2", cpuHasAvx2, convertDenseAvx2, byteSwapAvx2 },
+#else
+  { "avx512", cpuHasAvx512, convertDenseAvx512, byteSwapScalar },
+  { "avx2", cpuHasAvx2, convertDenseAvx2, byteSwapScalar },
+#endif
+#if defined(__SSE2__) && defined(RTAUDIO_SIMD_SWAP)
+  { "sse2", NULL, convertDenseBuffer, byteSwapSse2 },
+#elif defined(__SSE2__)
+  { "sse2", NULL, convertDenseBuffer, byteSwapScalar },
+#endif
+#elif defined(RTAUDIO_SIMD_CONVERT)
+#if defined(RTAUDIO_SIMD_SWAP)
+  { "neon", NULL, convertDenseNeon, byteSwapNeon },
+#else
+  { "neon", NULL, convertDenseNeon, byteSwapScalar },
+#endif
+#endif
+  { "scalar", NULL, convertDenseScalar, byteSwapScalar }
+};
+
+static const unsigned int kernelVariantCount = sizeof( kernelVariants ) / sizeof( kernelVariants[0] );
+
+// Probes the CPU once, as the library is loaded.
+static const KernelVariant *selectKernelVariant( void )
+{
+  for ( unsigned int i=0; i<kernelVariantCount; i++ )
+    if ( !kernelVariants[i].supported || kernelVariants[i].supported() )
+      return &kernelVariants[i];
+  return &kernelVariants[kernelVariantCount - 1];
+}
+
+static const KernelVariant *const bestKernels = selectKernelVariant();
+
+// Written by RtAudio::setKernelVariant() while streams may be converting,
+// like the stream counters.
+static const KernelVariant *activeKernels = bestKernels;
+
+static inline bool convertDense( char *outBuffer, char *inBuffer, RtAudioFormat outFormat,
+                                 RtAudioFormat inFormat, unsigned int samples )
+{
+  return STATS_LOAD( activeKernels )->convertDense( outBuffer, inBuffer, outFormat, inFormat, samples );
+}
+
+static inline void byteSwap( char *outBuffer, char *inBuffer, unsigned int samples, unsigned int bytes )
+{
+  STATS_LOAD( activeKernels )->byteSwap( outBuffer, inBuffer, samples, bytes );
+}
+
+void RtAudio :: getKernelVariants( std::vector<std::string> &variants ) throw()
+{
+  variants.clear();
+  for ( const KernelVariant *variant = bestKernels; variant < kernelVariants + kernelVariantCount; variant++ )
+    if ( !variant->supported || variant->supported() )
+      variants.push_back( variant->name );
+}
+
+const char *RtAudio :: getKernelVariant( void ) throw()
+{
+  return STATS_LOAD( activeKernels )->name;
+}
+
+bool RtAudio :: setKernelVariant( const std::string &variant ) throw()
+{
+  if ( variant.empty() ) {
+    STATS_STORE( activeKernels, bestKernels );
+    return true;
+  }
+  for ( unsigned int i=0; i<kernelVariantCount; i++ ) {
+    if ( variant != kernelVariants[i].name ) continue;
+    if ( kernelVariants[i].supported && !kernelVariants[i].supported() ) return false;
+    STATS_STORE( activeKernels, &kernelVariants[i] );
+    return true;
+  }
+  return false;
+}
+
+// The conversion plans: the loops of convertBuffer() as templates over the
+// formats, the layout of both buffers and the common channel counts, so
+// that each stream direction gets a loop with the sample conversion and
+// channel spacing built in.  SampleFormat describes a format by where its
+// most significant bit sits in a 32-bit integer and by its full scale.
+template <RtAudioFormat Format> struct SampleFormat;
+template <> struct SampleFormat<RTAUDIO_SINT8> {
+  typedef signed char Type; enum { isFloat = 0, mask = ~0, shift = 24 };
+  static double range() { return 127.5; }
+};
+template <> struct SampleFormat<RTAUDIO_SINT16> {
+  typedef short Type; enum { isFloat = 0, mask = ~0, shift = 16 };
+  static double range() { return 32767.5; }
+};
+template <> struct SampleFormat<RTAUDIO_SINT24> {
+  typedef int Type; enum { isFloat = 0, mask = 0x00ffffff, shift = 8 };
+  static double range() { return 8388607.5; }
+};
+template <> struct SampleFormat<RTAUDIO_SINT32> {
+  typedef int Type; enum { isFloat = 0, mask = ~0, shift = 0 };
+  static double range() { return 2147483647.5; }
+};
+template <> struct SampleFormat<RTAUDIO_FLOAT32> {
+  typedef float Type; enum { isFloat = 1 };
+};
+template <> struct SampleFormat<RTAUDIO_FLOAT64> {
+  typedef double Type; enum { isFloat = 1 };
+};
+
+// One sample, with the arithmetic of the general loops.
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat,
+          bool OutFloat = SampleFormat<OutFormat>::isFloat, bool InFloat = SampleFormat<InFormat>::isFloat>
+struct SampleConversion {
+  typedef typename SampleFormat<OutFormat>::Type Out;
+  typedef typename SampleFormat<InFormat>::Type In;
+  static inline Out convert( In in ) { return (Out) in; }  // float to float
+};
+
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat>
+struct SampleConversion<OutFormat, InFormat, true, false> {
+  typedef typename SampleFormat<OutFormat>::Type Out;
+  typedef typename SampleFormat<InFormat>::Type In;
+  static inline Out convert( In in ) {
+    Out value = (Out) ( in & SampleFormat<InFormat>::mask );
+    value += 0.5;
+    value *= (Out) ( 1.0 / SampleFormat<InFormat>::range() );
+    return value;
+  }
+};
+
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat>
+struct SampleConversion<OutFormat, InFormat, false, true> {
+  typedef typename SampleFormat<OutFormat>::Type Out;
+  typedef typename SampleFormat<InFormat>::Type In;
+  static inline Out convert( In in ) {
+    return (Out) ( in * SampleFormat<OutFormat>::range() - 0.5 );
+  }
+};
+
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat>
+struct SampleConversion<OutFormat, InFormat, false, false> {
+  typedef typename SampleFormat<OutFormat>::Type Out;
+  typedef typename SampleFormat<InFormat>::Type In;
+  enum { shift = (int) SampleFormat<InFormat>::shift - (int) SampleFormat<OutFormat>::shift };
+  static inline Out convert( In in ) {
+    if ( shift >= 0 ) return (Out) ( (int) in << ( shift >= 0 ? shift : 0 ) );
+    return (Out) ( (int) in >> ( shift < 0 ? -shift : 0 ) );
+  }
+};
+
+// The frame loop of the plans.  Channels is 0 for a channel count only
+// known at run time.
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, int Channels>
+static inline void convertFrames( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                                  int outJump, int inJump, unsigned int outStride, unsigned int inStride )
+{
+  typedef SampleConversion<OutFormat, InFormat> Conversion;
+  typename Conversion::Out * __restrict out = (typename Conversion::Out *) outBuffer;
+  const typename Conversion::In * __restrict in = (const typename Conversion::In *) inBuffer;
+  if ( Channels ) channels = Channels;
+
+  for ( unsigned int i=0; i<frames; i++ ) {
+    for ( int j=0; j<channels; j++ )
+      out[j * outStride] = Conversion::convert( in[j * inStride] );
+    in += inJump;
+    out += outJump;
+  }
 }
 
-void RtApi :: convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info )
+// A non-interleaved buffer has its channels a whole buffer apart.
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, int Channels, bool OutPlanar, bool InPlanar>
+static void convertPlanned( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                            int outJump, int inJump )
+{
+  convertFrames<OutFormat, InFormat, Channels>( outBuffer, inBuffer, frames, channels, outJump, inJump,
+                                                OutPlanar ? frames : 1, InPlanar ? frames : 1 );
+}
+
+// A flat run of frames * channels samples.  convertDense() covers the pairs
+// with a float side; integer to integer runs are one loop.  Byte swapping
+// goes in blocks, as in convertPlannedBlocks().
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, PlanSwap Swap>
+static void convertPlannedDense( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                                 int, int )
+{
+  const unsigned int inBytes = sizeof( typename SampleFormat<InFormat>::Type );
+  const unsigned int outBytes = sizeof( typename SampleFormat<OutFormat>::Type );
+  unsigned int samples = frames * channels;
+  unsigned int block = ( Swap == PLAN_SWAP_NONE ) ? samples : 1024;
+
+  for ( unsigned int i=0; i<samples; i+=block ) {
+    unsigned int n = ( samples - i < block ) ? samples - i : block;
+    char *in = inBuffer + i * inBytes;
+    char *out = outBuffer + i * outBytes;
+    if ( Swap == PLAN_SWAP_IN ) byteSwap( in, in, n, inBytes );
+    if ( SampleFormat<OutFormat>::isFloat || SampleFormat<InFormat>::isFloat )
+      convertDense( out, in, OutFormat, InFormat, n );
+    else
+      convertFrames<OutFormat, InFormat, 1>( out, in, n, 1, 1, 1, 1, 1 );
+    if ( Swap == PLAN_SWAP_OUT ) byteSwap( out, out, n, outBytes );
+  }
+}
+
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, bool OutPlanar, bool InPlanar>
+static ConversionPlan selectConversionPlan( int channels )
+{
+  switch ( channels ) {
+  case 1: return convertPlanned<OutFormat, InFormat, 1, OutPlanar, InPlanar>;
+  case 2: return convertPlanned<OutFormat, InFormat, 2, OutPlanar, InPlanar>;
+  case 6: return convertPlanned<OutFormat, InFormat, 6, OutPlanar, InPlanar>;
+  case 8: return convertPlanned<OutFormat, InFormat, 8, OutPlanar, InPlanar>;
+  }
+  return convertPlanned<OutFormat, InFormat, 0, OutPlanar, InPlanar>;
+}
+
+// The byte swap of interleaved device samples that start the buffer, done
+// a few kB of whole frames at a time, in place, right before the frames are
+// converted or right after, while they are still in the L1 cache.  The
+// device buffer ends up as the separate passes over it left it.  Between
+// interleaved buffers a block is converted by the plan without swapping.
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, bool OutPlanar, bool InPlanar, PlanSwap Swap>
+static void convertPlannedBlocks( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                                  int outJump, int inJump )
+{
+  const unsigned int inBytes = sizeof( typename SampleFormat<InFormat>::Type );
+  const unsigned int outBytes = sizeof( typename SampleFormat<OutFormat>::Type );
+  unsigned int frameBytes = ( Swap == PLAN_SWAP_IN ) ? inJump * inBytes : outJump * outBytes;
+  unsigned int block = ( frameBytes < 4096 ) ? 4096 / frameBytes : 1;
+  ConversionPlan plan = 0;
+  if ( !OutPlanar && !InPlanar )
+    plan = selectConversionPlan<OutFormat, InFormat, false, false>( channels );
+
+  for ( unsigned int i=0; i<frames; i+=block ) {
+    unsigned int n = ( frames - i < block ) ? frames - i : block;
+    char *in = inBuffer + i * inJump * inBytes;
+    char *out = outBuffer + i * outJump * outBytes;
+    if ( Swap == PLAN_SWAP_IN ) byteSwap( in, in, n * inJump, inBytes );
+    if ( plan )
+      plan( out, in, n, channels, outJump, inJump );
+    else
+      convertFrames<OutFormat, InFormat, 0>( out, in, n, channels, outJump, inJump,
+                                             OutPlanar ? frames : 1, InPlanar ? frames : 1 );
+    if ( Swap == PLAN_SWAP_OUT ) byteSwap( out, out, n * outJump, outBytes );
+  }
+}
+
+// blocks: the device samples are interleaved and start the buffer.  Other
+// layouts get no byte-swapping plan, the buffer is swapped in a pass of its own.
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat, PlanSwap Swap>
+static ConversionPlan selectSwappingPlan( bool dense, bool outPlanar, bool inPlanar, bool blocks )
+{
+  if ( dense ) return convertPlannedDense<OutFormat, InFormat, Swap>;
+  if ( !blocks ) return 0;
+  if ( outPlanar ) return convertPlannedBlocks<OutFormat, InFormat, true, false, Swap>;
+  if ( inPlanar ) return convertPlannedBlocks<OutFormat, InFormat, false, true, Swap>;
+  return convertPlannedBlocks<OutFormat, InFormat, false, false, Swap>;
+}
+
+template <RtAudioFormat OutFormat, RtAudioFormat InFormat>
+static ConversionPlan selectConversionPlan( bool dense, int channels, bool outPlanar, bool inPlanar,
+                                            PlanSwap swap, bool blocks )
+{
+  if ( swap == PLAN_SWAP_IN )
+    return selectSwappingPlan<OutFormat, InFormat, PLAN_SWAP_IN>( dense, outPlanar, inPlanar, blocks );
+  if ( swap == PLAN_SWAP_OUT )
+    return selectSwappingPlan<OutFormat, InFormat, PLAN_SWAP_OUT>( dense, outPlanar, inPlanar, blocks );
+  if ( dense ) return convertPlannedDense<OutFormat, InFormat, PLAN_SWAP_NONE>;
+  if ( outPlanar && inPlanar ) return selectConversionPlan<OutFormat, InFormat, true, true>( channels );
+  if ( outPlanar ) return selectConversionPlan<OutFormat, InFormat, true, false>( channels );
+  if ( inPlanar ) return selectConversionPlan<OutFormat, InFormat, false, true>( channels );
+  return selectConversionPlan<OutFormat, InFormat, false, false>( channels );
+}
+
+template <RtAudioFormat OutFormat>
+static ConversionPlan selectConversionPlan( RtAudioFormat inFormat, bool dense, int channels,
+                                            bool outPlanar, bool inPlanar, PlanSwap swap, bool blocks )
+{
+  switch ( inFormat ) {
+  case RTAUDIO_SINT8:
+    return selectConversionPlan<OutFormat, RTAUDIO_SINT8>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT16:
+    return selectConversionPlan<OutFormat, RTAUDIO_SINT16>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT24:
+    return selectConversionPlan<OutFormat, RTAUDIO_SINT24>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT32:
+    return selectConversionPlan<OutFormat, RTAUDIO_SINT32>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_FLOAT32:
+    return selectConversionPlan<OutFormat, RTAUDIO_FLOAT32>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_FLOAT64:
+    return selectConversionPlan<OutFormat, RTAUDIO_FLOAT64>( dense, channels, outPlanar, inPlanar, swap, blocks );
+  }
+  return 0;
+}
+
+// Returns 0 for an undefined format, convertBuffer() then runs the general loops.
+static ConversionPlan selectConversionPlan( RtAudioFormat outFormat, RtAudioFormat inFormat, bool dense,
+                                            int channels, bool outPlanar, bool inPlanar, PlanSwap swap,
+                                            bool blocks )
+{
+  switch ( outFormat ) {
+  case RTAUDIO_SINT8:
+    return selectConversionPlan<RTAUDIO_SINT8>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT16:
+    return selectConversionPlan<RTAUDIO_SINT16>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT24:
+    return selectConversionPlan<RTAUDIO_SINT24>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_SINT32:
+    return selectConversionPlan<RTAUDIO_SINT32>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_FLOAT32:
+    return selectConversionPlan<RTAUDIO_FLOAT32>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  case RTAUDIO_FLOAT64:
+    return selectConversionPlan<RTAUDIO_FLOAT64>( inFormat, dense, channels, outPlanar, inPlanar, swap, blocks );
+  }
+  return 0;
+}
+
+void RtApi :: convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info, bool byteSwap )
 {
   // This function does format conversion, input/output channel compensation, and
   // data interleaving/deinterleaving.  24-bit integers are assumed to occupy
@@ -7846,6 +9297,13 @@ void RtApi :: convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info
        ( stream_.nDeviceChannels[0] < stream_.nDeviceChannels[1] ) )
     memset( outBuffer, 0, stream_.bufferSize * info.outJump * formatBytes( info.outFormat ) );
 
+  ConvertInfo::Plan plan = byteSwap ? info.swapPlan : info.plan;
+  if ( plan ) {
+    plan( outBuffer + info.outStart, inBuffer + info.inStart, stream_.bufferSize,
+          info.channels, info.outJump, info.inJump );
+    return;
+  }
+
   int j;
   if (info.outFormat == RTAUDIO_FLOAT64) {
     Float64 scale;
@@ -8274,69 +9732,14 @@ void RtApi :: convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info
 
 void RtApi :: byteSwapBuffer( char *buffer, unsigned int samples, RtAudioFormat format )
 {
-  register char val;
-  register char *ptr;
-
-  ptr = buffer;
-  if ( format == RTAUDIO_SINT16 ) {
-    for ( unsigned int i=0; i<samples; i++ ) {
-      // Swap 1st and 2nd bytes.
-      val = *(ptr);
-      *(ptr) = *(ptr+1);
-      *(ptr+1) = val;
-
-      // Increment 2 bytes.
-      ptr += 2;
-    }
-  }
+  if ( format == RTAUDIO_SINT16 )
+    byteSwap( buffer, buffer, samples, 2 );
   else if ( format == RTAUDIO_SINT24 ||
             format == RTAUDIO_SINT32 ||
-            format == RTAUDIO_FLOAT32 ) {
-    for ( unsigned int i=0; i<samples; i++ ) {
-      // Swap 1st and 4th bytes.
-      val = *(ptr);
-      *(ptr) = *(ptr+3);
-      *(ptr+3) = val;
-
-      // Swap 2nd and 3rd bytes.
-      ptr += 1;
-      val = *(ptr);
-      *(ptr) = *(ptr+1);
-      *(ptr+1) = val;
-
-      // Increment 3 more bytes.
-      ptr += 3;
-    }
-  }
-  else if ( format == RTAUDIO_FLOAT64 ) {
-    for ( unsigned int i=0; i<samples; i++ ) {
-      // Swap 1st and 8th bytes
-      val = *(ptr);
-      *(ptr) = *(ptr+7);
-      *(ptr+7) = val;
-
-      // Swap 2nd and 7th bytes
-      ptr += 1;
-      val = *(ptr);
-      *(ptr) = *(ptr+5);
-      *(ptr+5) = val;
-
-      // Swap 3rd and 6th bytes
-      ptr += 1;
-      val = *(ptr);
-      *(ptr) = *(ptr+3);
-      *(ptr+3) = val;
-
-      // Swap 4th and 5th bytes
-      ptr += 1;
-      val = *(ptr);
-      *(ptr) = *(ptr+1);
-      *(ptr+1) = val;
-
-      // Increment 5 more bytes.
-      ptr += 5;
-    }
-  }
+            format == RTAUDIO_FLOAT32 )
+    byteSwap( buffer, buffer, samples, 4 );
+  else if ( format == RTAUDIO_FLOAT64 )
+    byteSwap( buffer, buffer, samples, 8 );
 }
 
   // Indentation settings for Vim and Emacs
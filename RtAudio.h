@@ -87,6 +87,7 @@ static const RtAudioFormat RTAUDIO_FLOAT64 = 0x20; // Normalized between plus/mi
     - \e RTAUDIO_MINIMIZE_LATENCY: Attempt to set stream parameters for lowest possible latency.
     - \e RTAUDIO_HOG_DEVICE:       Attempt grab device for exclusive use.
     - \e RTAUDIO_ALSA_USE_DEFAULT: Use the "default" PCM device (ALSA only).
+    - \e RTAUDIO_HUGE_PAGES:       Back the stream buffers with huge pages (ALSA only).
 
     By default, RtAudio streams pass and receive audio data from the
     client in an interleaved format.  By passing the
@@ -118,6 +119,10 @@ static const RtAudioFormat RTAUDIO_FLOAT64 = 0x20; // Normalized between plus/mi
     If the RTAUDIO_ALSA_USE_DEFAULT flag is set, RtAudio will attempt to
     open the "default" PCM device when using the ALSA API. Note that this
     will override any specified input or output device id.
+
+    If the RTAUDIO_HUGE_PAGES flag is set, RtAudio will try to map the
+    stream buffers on huge pages, falling back to regular pages when
+    the system has none reserved (see RtAudio::StreamMemory).
 */
 typedef unsigned int RtAudioStreamFlags;
 static const RtAudioStreamFlags RTAUDIO_NONINTERLEAVED = 0x1;    // Use non-interleaved buffers (default = interleaved).
@@ -125,6 +130,7 @@ static const RtAudioStreamFlags RTAUDIO_MINIMIZE_LATENCY = 0x2;  // Attempt to s
 static const RtAudioStreamFlags RTAUDIO_HOG_DEVICE = 0x4;        // Attempt grab device and prevent use by others.
 static const RtAudioStreamFlags RTAUDIO_SCHEDULE_REALTIME = 0x8; // Try to select realtime scheduling for callback thread.
 static const RtAudioStreamFlags RTAUDIO_ALSA_USE_DEFAULT = 0x10; // Use the "default" PCM device (ALSA only).
+static const RtAudioStreamFlags RTAUDIO_HUGE_PAGES = 0x20;       // Back the stream buffers with huge pages (ALSA only).
 
 /*! \typedef typedef unsigned long RtAudioStreamStatus;
     \brief RtAudio stream status (over- or underflow) flags.
@@ -186,6 +192,44 @@ typedef int (*RtAudioCallback)( void *outputBuffer, void *inputBuffer,
                                 RtAudioStreamStatus status,
                                 void *userData );
 
+/*! \typedef typedef unsigned int RtAudioTraceEvent;
+    \brief What the callback thread is doing, as reported to an RtAudioTraceHook.
+
+    - \e RTAUDIO_TRACE_WAKEUP:    The callback thread starts a period (instant).
+    - \e RTAUDIO_TRACE_CALLBACK:  The client callback runs.
+    - \e RTAUDIO_TRACE_CONVERT:   Samples are byte swapped and/or converted.
+    - \e RTAUDIO_TRACE_READ:      The thread reads from or waits on the input device.
+    - \e RTAUDIO_TRACE_WRITE:     The thread writes to or waits on the output device.
+    - \e RTAUDIO_TRACE_OVERFLOW:  The input device overflowed (instant).
+    - \e RTAUDIO_TRACE_UNDERFLOW: The output device underflowed (instant).
+*/
+typedef unsigned int RtAudioTraceEvent;
+static const RtAudioTraceEvent RTAUDIO_TRACE_WAKEUP = 0;
+static const RtAudioTraceEvent RTAUDIO_TRACE_CALLBACK = 1;
+static const RtAudioTraceEvent RTAUDIO_TRACE_CONVERT = 2;
+static const RtAudioTraceEvent RTAUDIO_TRACE_READ = 3;
+static const RtAudioTraceEvent RTAUDIO_TRACE_WRITE = 4;
+static const RtAudioTraceEvent RTAUDIO_TRACE_OVERFLOW = 5;
+static const RtAudioTraceEvent RTAUDIO_TRACE_UNDERFLOW = 6;
+
+/*! \typedef typedef unsigned int RtAudioTracePhase;
+    \brief Whether a traced event begins, ends or is instantaneous.
+*/
+typedef unsigned int RtAudioTracePhase;
+static const RtAudioTracePhase RTAUDIO_TRACE_BEGIN = 0;
+static const RtAudioTracePhase RTAUDIO_TRACE_END = 1;
+static const RtAudioTracePhase RTAUDIO_TRACE_INSTANT = 2;
+
+//! RtAudio trace hook prototype, see RtAudio::setTraceHook().
+/*!
+   The hook is called on the callback thread as the events happen, so
+   it must be quick and must not block; a client would typically just
+   timestamp the event into a preallocated buffer.
+ */
+typedef void (*RtAudioTraceHook)( RtAudioTraceEvent event,
+                                  RtAudioTracePhase phase,
+                                  void *userData );
+
 
 // **************************************************************** //
 //
@@ -306,8 +350,8 @@ class RtAudio
     RtAudio with Jack, each instance must have a unique client name.
   */
   struct StreamOptions {
-    RtAudioStreamFlags flags;      /*!< A bit-mask of stream flags (RTAUDIO_NONINTERLEAVED, RTAUDIO_MINIMIZE_LATENCY, RTAUDIO_HOG_DEVICE, RTAUDIO_ALSA_USE_DEFAULT). */
-    unsigned int numberOfBuffers;  /*!< Number of stream buffers. */
+    RtAudioStreamFlags flags;      /*!< A bit-mask of stream flags (RTAUDIO_NONINTERLEAVED, RTAUDIO_MINIMIZE_LATENCY, RTAUDIO_HOG_DEVICE, RTAUDIO_ALSA_USE_DEFAULT, RTAUDIO_HUGE_PAGES). */
+    unsigned int numberOfBuffers;  /*!< Number of stream buffers, set to the number actually used on return (ALSA). */
     std::string streamName;        /*!< A stream name (currently used only in Jack). */
     int priority;                  /*!< Scheduling priority of callback thread (only used with flag RTAUDIO_SCHEDULE_REALTIME). */
 
@@ -316,6 +360,51 @@ class RtAudio
     : flags(0), numberOfBuffers(0), priority(0) {}
   };
 
+  //! The number of buckets in the callback time histogram of StreamStats.
+  /*!
+    Times below 32 nanoseconds get a bucket each, above that every
+    power of two is split into 16 buckets, up to 2^40 nanoseconds.
+  */
+  static const unsigned int STATS_BUCKETS = 608;
+
+  //! The performance counters of a stream, see getStreamStats().
+  /*!
+    All times are in nanoseconds.  The callback thread updates the
+    counters while the stream runs, so a copy taken meanwhile is not
+    guaranteed to be consistent from one field to the next.
+  */
+  struct StreamStats {
+    unsigned long long periods;        /*!< Number of callbacks made. */
+    unsigned long long underflows;     /*!< Callbacks that reported an output underflow. */
+    unsigned long long overflows;      /*!< Callbacks that reported an input overflow. */
+    unsigned long long callbackNanos;  /*!< Total time spent in the callback. */
+    unsigned long long callbackMax;    /*!< The slowest callback. */
+    unsigned long long convertNanos;   /*!< Total time spent converting and byte swapping samples. */
+    unsigned long long convertMax;
+    unsigned long long deviceNanos;    /*!< Total time blocked reading from or writing to the device. */
+    unsigned long long deviceMax;
+    unsigned long long busyMax;        /*!< The longest period spent in the callback and conversions. */
+    unsigned long long histogram[STATS_BUCKETS]; /*!< Callback times, see statsBucket(). */
+  };
+
+  //! The memory held by the buffers of a stream, see getStreamMemory().
+  /*!
+    The ALSA API maps the user and device buffers of a stream as one
+    arena, each buffer on a 64-byte boundary, and touches and locks
+    its pages as the stream opens so that the callbacks do not fault
+    on them.  Locking is subject to RLIMIT_MEMLOCK.  A user buffer
+    exchanged in with exchangeUserBuffer() counts as part of the arena
+    when it came from allocateUserBuffer(); one allocated with malloc()
+    makes the buffers count as not locked.
+  */
+  struct StreamMemory {
+    unsigned long userBytes[2];    /*!< The user buffers, playback and record. */
+    unsigned long deviceBytes;     /*!< The buffer device samples are converted in, 0 when none is needed. */
+    unsigned long arenaBytes;      /*!< The memory mapped for the buffers, 0 when they are allocated one by one. */
+    bool locked;                   /*!< The arena and any user buffers exchanged in are locked in memory. */
+    bool hugePages;                /*!< The arena is backed by huge pages. */
+  };
+
   //! A static function to determine the available compiled audio APIs.
   /*!
     The values returned in the std::vector can be compared against
@@ -366,6 +455,71 @@ class RtAudio
   */
   RtAudio::DeviceInfo getDeviceInfo( unsigned int device );
 
+  //! Return the RtAudio::DeviceInfo structures of all devices at once.
+  /*!
+    Unlike getDeviceInfo(), APIs which keep a device list (ALSA)
+    probe the devices only the first time this is called and return
+    the saved results afterwards, until invalidateDeviceInfo() is
+    called.  Opening a stream also refreshes the saved results.
+  */
+  std::vector<RtAudio::DeviceInfo> getAllDeviceInfo( void );
+
+  //! Discard the device information saved by getAllDeviceInfo().
+  /*!
+    The next call to getAllDeviceInfo() probes the devices again,
+    picking up devices connected or removed in the meantime.  APIs
+    which keep a device list (ALSA) also use it for getDeviceCount(),
+    getDeviceInfo() and openStream() until this is called.
+  */
+  void invalidateDeviceInfo( void ) throw();
+
+  //! Set the longest time a single device may take to be probed.
+  /*!
+    A device which does not answer in time, for instance because
+    another process holds it, is reported with "probed" set to
+    "false" instead of stalling the enumeration.  A value of zero or
+    less waits as long as a device takes.  Only ALSA probes devices
+    concurrently and honors the limit; the default is two seconds.
+    ALSA applies the same limit to listing the devices of each sound
+    card, and leaves out a card whose control does not answer.
+  */
+  void setProbeTimeout( double seconds ) throw();
+
+  //! Set a function to be told what the callback thread of a stream is doing.
+  /*!
+    The hook stays in place across streams until it is replaced; a
+    NULL \c hook removes it.  It must not be changed while a stream is
+    running.  Only the ALSA API reports events.
+  */
+  void setTraceHook( RtAudioTraceHook hook, void *userData = NULL ) throw();
+
+  //! Returns the histogram bucket a callback time in nanoseconds is counted in.
+  static unsigned int statsBucket( unsigned long long nanos ) throw();
+
+  //! Returns the shortest callback time in nanoseconds counted in a histogram bucket.
+  static unsigned long long statsBucketNanos( unsigned int bucket ) throw();
+
+  //! Returns the kernel variants this CPU can run, the fastest first.
+  /*!
+    A variant is the instruction set the sample conversion and byte
+    swapping kernels are built for: "avx512", "avx2", "sse2", "neon"
+    or "scalar", as far as the build has them.  The fastest one is
+    chosen when the library is loaded.
+  */
+  static void getKernelVariants( std::vector<std::string> &variants ) throw();
+
+  //! Returns the name of the kernel variant in use.
+  static const char *getKernelVariant( void ) throw();
+
+  //! Makes the conversions of all streams use another kernel variant, to compare them.
+  /*!
+    Running streams change over with their next buffer, the samples
+    are the same with every variant.  An empty \c variant goes back
+    to the fastest one.  Returns false, changing nothing, when the
+    variant is unknown or the CPU cannot run it.
+  */
+  static bool setKernelVariant( const std::string &variant ) throw();
+
   //! A function that returns the index of the default output device.
   /*!
     If the underlying audio API does not provide a "default
@@ -495,6 +649,56 @@ class RtAudio
  */
   unsigned int getStreamSampleRate( void );
 
+  //! Copies the performance counters of the stream into \c stats.
+  /*!
+    The counters start from zero when a stream is opened and keep
+    counting across stops and starts.  They are only kept by the ALSA
+    API; other APIs leave them at zero.  If a stream is not open, an
+    RtError (type = INVALID_USE) will be thrown.
+  */
+  void getStreamStats( RtAudio::StreamStats &stats );
+
+  //! Copies the sizes of the stream buffers, and how their memory is held, into \c memory.
+  /*!
+    If a stream is not open, an RtError (type = INVALID_USE) will be
+    thrown.
+  */
+  void getStreamMemory( RtAudio::StreamMemory &memory );
+
+  //! Sets the performance counters of the stream back to zero.
+  /*!
+    This may be called while the stream runs.  If a stream is not
+    open, an RtError (type = INVALID_USE) will be thrown.
+  */
+  void resetStreamStats( void );
+
+  //! Replaces the user buffer of one stream direction and returns the previous one.
+  /*!
+    This function is intended to be called from within the stream
+    callback only, so that a client can keep the buffer it was just
+    handed without copying it.  The new \c buffer must have been
+    allocated with allocateUserBuffer() or malloc() and be at least as
+    large as the buffer it replaces; it is freed by RtAudio when the
+    stream is closed.
+    Ownership of the returned buffer passes to the caller, who must
+    release it with freeUserBuffer(), as it may be part of the arena
+    of the stream buffers (see StreamMemory).  The arena stays mapped
+    until the stream is closed and all buffers lent out of it are
+    released.
+  */
+  char *exchangeUserBuffer( bool input, char *buffer );
+
+  //! Allocates a buffer to hand to exchangeUserBuffer(), or returns 0.
+  /*!
+    The buffer is mapped on its own, page aligned, with its pages
+    faulted in and locked like those of the stream arena.  Release it
+    with freeUserBuffer() unless a stream took it over.
+  */
+  static char *allocateUserBuffer( unsigned long bytes ) throw();
+
+  //! Releases a buffer returned by exchangeUserBuffer() or allocateUserBuffer().
+  static void freeUserBuffer( char *buffer ) throw();
+
   //! Specify whether warning messages should be printed to stderr.
   void showWarnings( bool value = true ) throw();
 
@@ -572,6 +776,9 @@ public:
   virtual RtAudio::Api getCurrentApi( void ) = 0;
   virtual unsigned int getDeviceCount( void ) = 0;
   virtual RtAudio::DeviceInfo getDeviceInfo( unsigned int device ) = 0;
+  virtual std::vector<RtAudio::DeviceInfo> getAllDeviceInfo( void );
+  virtual void invalidateDeviceInfo( void ) {};
+  virtual void setProbeTimeout( double seconds ) {};
   virtual unsigned int getDefaultInputDevice( void );
   virtual unsigned int getDefaultOutputDevice( void );
   void openStream( RtAudio::StreamParameters *outputParameters,
@@ -586,6 +793,11 @@ public:
   long getStreamLatency( void );
   unsigned int getStreamSampleRate( void );
   virtual double getStreamTime( void );
+  void getStreamStats( RtAudio::StreamStats &stats );
+  void getStreamMemory( RtAudio::StreamMemory &memory );
+  void resetStreamStats( void );
+  void setTraceHook( RtAudioTraceHook hook, void *userData ) { traceHook_ = hook; traceData_ = userData; };
+  char *exchangeUserBuffer( bool input, char *buffer );
   bool isStreamOpen( void ) const { return stream_.state != STREAM_CLOSED; };
   bool isStreamRunning( void ) const { return stream_.state == STREAM_RUNNING; };
   void showWarnings( bool value ) { showWarnings_ = value; };
@@ -619,6 +831,14 @@ protected:
     RtAudioFormat inFormat, outFormat;
     std::vector<int> inOffset;
     std::vector<int> outOffset;
+    bool dense; // in and out samples line up one to one, see setConvertInfo()
+    // the conversion loops setConvertInfo() picked for the formats, layout and
+    // channel count, called with the buffers advanced by inStart and outStart;
+    // swapPlan also byte-swaps the device samples, see convertBuffer()
+    typedef void (*Plan)( char *outBuffer, char *inBuffer, unsigned int frames, int channels,
+                          int outJump, int inJump );
+    Plan plan, swapPlan;
+    int inStart, outStart; // byte offsets of the first channel
   };
 
   // A protected structure for audio streams.
@@ -629,6 +849,11 @@ protected:
     StreamState state;         // STOPPED, RUNNING, or CLOSED
     char *userBuffer[2];       // Playback and record, respectively.
     char *deviceBuffer;
+    char *arena;               // holds the buffers above, see allocateStreamBuffers()
+    void *arenaEntry;          // the registry entry counting the arena holders
+    unsigned long arenaBytes;
+    bool arenaLocked;
+    bool arenaHugePages;
     bool doConvertBuffer[2];   // Playback and record, respectively.
     bool userInterleaved;
     bool deviceInterleaved[2]; // Playback and record, respectively.
@@ -652,7 +877,7 @@ protected:
 #endif
 
     RtApiStream()
-      :apiHandle(0), deviceBuffer(0) { device[0] = 11111; device[1] = 11111; }
+      :apiHandle(0), deviceBuffer(0), arena(0), arenaEntry(0), arenaBytes(0), arenaLocked(false), arenaHugePages(false) { device[0] = 11111; device[1] = 11111; }
   };
 
   typedef signed short Int16;
@@ -664,6 +889,9 @@ protected:
   std::string errorText_;
   bool showWarnings_;
   RtApiStream stream_;
+  RtAudio::StreamStats stats_; // written by the callback thread only, see statsAdd()
+  RtAudioTraceHook traceHook_;
+  void *traceData_;
 
   /*!
     Protected, api-specific method that attempts to open a device
@@ -680,9 +908,40 @@ protected:
   //! A protected function used to increment the stream time.
   void tickStreamTime( void );
 
+  //! Protected method that returns a monotonic time in nanoseconds for the stream counters.
+  static unsigned long long statsClock( void );
+
+  //! Protected method that adds a time to one of the counters and keeps its maximum.
+  void statsAdd( unsigned long long &total, unsigned long long &max, unsigned long long nanos );
+
+  //! Protected method that counts one callback and the time it took.
+  void statsCallback( RtAudioStreamStatus status, unsigned long long nanos );
+
+  //! Protected method that reports an event to the trace hook, if any.
+  void trace( RtAudioTraceEvent event, RtAudioTracePhase phase )
+  {
+    if ( traceHook_ ) traceHook_( event, phase, traceData_ );
+  };
+
   //! Protected common method to clear an RtApiStream structure.
   void clearStreamInfo();
 
+  /*!
+    Protected common method that allocates the user buffers of the
+    open directions and, if either converts, the device buffer, all
+    in one arena.  Returns false if the memory cannot be had.
+  */
+  bool allocateStreamBuffers( bool hugePages );
+
+  //! Protected common method that releases the stream buffers and their arena.
+  void freeStreamBuffers( void );
+
+  //! Protected common method that returns the size of the user buffer of a direction.
+  unsigned long userBufferBytes( int mode );
+
+  //! Protected common method that returns the size of the device buffer.
+  unsigned long deviceBufferBytes( void );
+
   /*!
     Protected common method that throws an RtError (type =
     INVALID_USE) if a stream is not open.
@@ -694,9 +953,11 @@ protected:
 
   /*!
     Protected method used to perform format, channel number, and/or interleaving
-    conversions between the user and device buffers.
+    conversions between the user and device buffers.  With \c byteSwap, the
+    device buffer samples are byte-swapped along with the conversion, which
+    needs the \c swapPlan of \c info.
   */
-  void convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info );
+  void convertBuffer( char *outBuffer, char *inBuffer, ConvertInfo &info, bool byteSwap = false );
 
   //! Protected common method used to perform byte-swapping on buffers.
   void byteSwapBuffer( char *buffer, unsigned int samples, RtAudioFormat format );
@@ -717,6 +978,9 @@ protected:
 inline RtAudio::Api RtAudio :: getCurrentApi( void ) throw() { return rtapi_->getCurrentApi(); }
 inline unsigned int RtAudio :: getDeviceCount( void ) throw() { return rtapi_->getDeviceCount(); }
 inline RtAudio::DeviceInfo RtAudio :: getDeviceInfo( unsigned int device ) { return rtapi_->getDeviceInfo( device ); }
+inline std::vector<RtAudio::DeviceInfo> RtAudio :: getAllDeviceInfo( void ) { return rtapi_->getAllDeviceInfo(); }
+inline void RtAudio :: invalidateDeviceInfo( void ) throw() { rtapi_->invalidateDeviceInfo(); }
+inline void RtAudio :: setProbeTimeout( double seconds ) throw() { rtapi_->setProbeTimeout( seconds ); }
 inline unsigned int RtAudio :: getDefaultInputDevice( void ) throw() { return rtapi_->getDefaultInputDevice(); }
 inline unsigned int RtAudio :: getDefaultOutputDevice( void ) throw() { return rtapi_->getDefaultOutputDevice(); }
 inline void RtAudio :: closeStream( void ) throw() { return rtapi_->closeStream(); }
@@ -728,6 +992,11 @@ inline bool RtAudio :: isStreamRunning( void ) const throw() { return rtapi_->is
 inline long RtAudio :: getStreamLatency( void ) { return rtapi_->getStreamLatency(); }
 inline unsigned int RtAudio :: getStreamSampleRate( void ) { return rtapi_->getStreamSampleRate(); };
 inline double RtAudio :: getStreamTime( void ) { return rtapi_->getStreamTime(); }
+inline void RtAudio :: getStreamStats( RtAudio::StreamStats &stats ) { rtapi_->getStreamStats( stats ); }
+inline void RtAudio :: getStreamMemory( RtAudio::StreamMemory &memory ) { rtapi_->getStreamMemory( memory ); }
+inline void RtAudio :: resetStreamStats( void ) { rtapi_->resetStreamStats(); }
+inline void RtAudio :: setTraceHook( RtAudioTraceHook hook, void *userData ) throw() { rtapi_->setTraceHook( hook, userData ); }
+inline char *RtAudio :: exchangeUserBuffer( bool input, char *buffer ) { return rtapi_->exchangeUserBuffer( input, buffer ); }
 inline void RtAudio :: showWarnings( bool value ) throw() { rtapi_->showWarnings( value ); }
 
 // RtApi Subclass prototypes.
@@ -881,6 +1150,8 @@ public:
 
 #if defined(__LINUX_ALSA__)
 
+struct AlsaProbe;
+
 class RtApiAlsa: public RtApi
 {
 public:
@@ -890,6 +1161,9 @@ public:
   RtAudio::Api getCurrentApi() { return RtAudio::LINUX_ALSA; };
   unsigned int getDeviceCount( void );
   RtAudio::DeviceInfo getDeviceInfo( unsigned int device );
+  std::vector<RtAudio::DeviceInfo> getAllDeviceInfo( void );
+  void invalidateDeviceInfo( void ) { devicesSaved_ = false; mapSaved_ = false; };
+  void setProbeTimeout( double seconds ) { probeTimeout_ = seconds; };
   void closeStream( void );
   void startStream( void );
   void stopStream( void );
@@ -901,9 +1175,30 @@ public:
   // will most likely produce highly undesireable results!
   void callbackEvent( void );
 
+  // Likewise for internal use only, it is called by the device probe
+  // threads.  It does not touch the RtApiAlsa object, any warnings
+  // are returned for the calling thread to report.
+  static void probeDevice( int card, int subdevice, RtAudio::DeviceInfo &info,
+                           std::vector<std::string> &warnings );
+  static void walkCard( int card, std::vector<int> &subdevices,
+                        std::vector<std::string> &warnings );
+
   private:
 
+  typedef std::vector< std::pair<int, int> > DeviceMap; // device index -> (card, subdevice)
+
   std::vector<RtAudio::DeviceInfo> devices_;
+  DeviceMap deviceIds_; // (card, subdevice) of each entry of devices_
+  bool devicesSaved_; // devices_ holds a complete probe, see getAllDeviceInfo()
+  DeviceMap map_;
+  bool mapSaved_; // map_ holds the current device list, see deviceMap()
+  std::pair<int, int> streamIds_[2]; // (card, subdevice) of the stream devices
+  double probeTimeout_;
+  void mapDevices( DeviceMap &map );
+  DeviceMap const &deviceMap( void );
+  bool isStreamDevice( std::pair<int, int> const &id );
+  void runProbe( AlsaProbe *probe );
+  std::vector<RtAudio::DeviceInfo> probeDevices( DeviceMap const &map, std::vector<unsigned int> const &devices );
   void saveDeviceInfo( void );
   bool probeDeviceOpen( unsigned int device, StreamMode mode, unsigned int channels, 
                         unsigned int firstChannel, unsigned int sampleRate,
@@ -0,0 +1,50 @@
+import pyrtaudio as p
+import resource, sys, time
+
+## callback overhead benchmark
+# Runs a trivial in-place render callback at a few buffer sizes, once with
+# the legacy invocation path (a new thread state and argument tuple every
+# period) and once with fast_callback, and reports the process cpu time
+# spent per callback. The callback itself does next to nothing, so the
+# difference is the cost of getting into and out of the interpreter.
+# A second table keeps the device period at 64 frames and sweeps the batch
+# size, reporting the cpu time per device period and the latency it adds.
+device = int(sys.argv[1]) if len(sys.argv) > 1 else 0
+seconds = 2.0
+rate = 48000
+channels = 2
+
+calls = [0]
+def callback(output):
+    calls[0] += 1
+
+def cpu_time():
+    t = resource.getrusage(resource.RUSAGE_SELF)
+    return t.ru_utime + t.ru_stime
+
+def run(bframes, options):
+    options['in_place'] = True
+    r = p.RtAudio()
+    r.open_stream({'device_id':device, 'channels':channels, 'first_channel':0},
+            None, p.RTAUDIO_SINT16, rate, bframes, callback, options)
+    latency = r.get_stream_latency()
+    calls[0] = 0
+    start = cpu_time()
+    r.start_stream()
+    time.sleep(seconds)
+    r.stop_stream()
+    used = cpu_time() - start
+    r.close_stream()
+    return used * 1e6 / max(calls[0], 1), calls[0], latency
+
+print '%8s %16s %16s' % ('frames', 'legacy us/call', 'fast us/call')
+for bframes in (16, 32, 64, 128, 256):
+    legacy = run(bframes, {'fast_callback': False})[0]
+    fast = run(bframes, {'fast_callback': True})[0]
+    print '%8d %16.2f %16.2f' % (bframes, legacy, fast)
+
+print
+print '%8s %16s %16s %16s' % ('batch', 'us/call', 'us/period', 'latency frames')
+for batch in (1, 2, 4, 8, 16):
+    used, n, latency = run(64, {'batch': batch})
+    print '%8d %16.2f %16.2f %16d' % (batch, used, used / batch, latency)
@@ -33,6 +33,14 @@ r.close_stream()
 
 fr.close()
 
+## the same without python in the audio path: the file is memory mapped
+## and played natively, on_complete runs on the main thread at the end
+finished = []
+r.play_file('somefile.wav', {'on_complete': lambda: finished.append(True)})
+while not finished:
+    time.sleep(0.1)
+r.close_stream()
+
 ## simple recording (capture) example
 channels = 1
 rate = 44100
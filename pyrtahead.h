@@ -0,0 +1,45 @@
+#ifndef _PYRTAHEAD_
+#define _PYRTAHEAD_
+
+#include <stdlib.h>
+#include <pthread.h>
+
+// In render-ahead mode the python callback runs on a worker thread which
+// keeps the output ring a number of periods ahead of the device. The
+// RtAudio callback only dequeues, so a slow period of python is absorbed by
+// the queued ones instead of causing an underrun.
+
+typedef struct {
+    pthread_t worker;
+    int running;               // the worker thread exists
+    int quit;
+    unsigned int target;       // periods to keep queued, see set_render_ahead
+    int retcode;               // the first nonzero return of the callback
+    char *block;               // the period the callback renders into
+    unsigned int frames;
+    double period;             // length of a period in seconds
+    unsigned long produced;    // periods rendered since the stream was opened
+} PyRtRenderAhead;
+
+inline void aheadDestroy(PyRtRenderAhead *a) {
+    if (!a) return;
+    free(a->block);
+    free(a);
+}
+
+inline PyRtRenderAhead *aheadCreate(size_t len, unsigned int target, unsigned int frames,
+        unsigned int rate) {
+    PyRtRenderAhead *a = (PyRtRenderAhead *) calloc(1, sizeof(PyRtRenderAhead));
+    if (!a) return NULL;
+    a->block = (char *) calloc(1, len);
+    if (!a->block) {
+        aheadDestroy(a);
+        return NULL;
+    }
+    a->target = target;
+    a->frames = frames;
+    a->period = (double) frames / rate;
+    return a;
+}
+
+#endif
@@ -19,20 +19,44 @@
 */
 
 #include <Python.h>
+#include <pythread.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#include <algorithm>
 
 #include "RtAudio.h"
 #include "pyrtutils.h"
+#include "pyrtring.h"
+#include "pyrtdeadline.h"
+#include "pyrtahead.h"
+#include "pyrtbatch.h"
+#include "pyrtfile.h"
+#include "pyrtrecord.h"
+#include "pyrttune.h"
+#include "pyrtstats.h"
+#include "pyrttrace.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define PYGILSTATE_ACQUIRE PyGILState_STATE gstate; \
-    do { gstate = PyGILState_Ensure(); } while (0)
-
-#define PYGILSTATE_RELEASE do { PyGILState_Release(gstate); } while (0)
+// pyrtaudio.StreamBuffer
+typedef struct {
+    PyObject_HEAD
+    char *_buf;                 // the wrapped memory
+    Py_ssize_t _len;            // length of the wrapped memory in bytes
+    int _readonly;
+    int _owned;                 // _buf belongs to this object and is freed with it
+    // buffer interface metadata, see describeStreamBuffer
+    char const *_format;
+    Py_ssize_t _itemsize;
+    int _ndim;
+    Py_ssize_t _shape[2];
+    Py_ssize_t _strides[2];
+} PyRtAudioBufferObject;
 
 // pyrtaudio.RtAudio()
 typedef struct {
@@ -43,6 +67,68 @@ typedef struct {
     Py_buffer *_outputView;     // pre-allocated space for an output buffer
     unsigned long _expectedOutputBufferLength;
     unsigned long _expectedInputBufferLength;
+    int _zeroCopy;              // hand the RtApi input buffer to python without copying
+    PyRtAudioBufferObject *_inputBuffer; // wraps the RtApi input buffer in zero copy mode
+    PyRtAudioBufferObject *_outputBuffer; // wraps the RtApi output buffer in in-place mode
+    // ring mode: the callback only moves audio between the device and these
+    unsigned int _ringDepth;    // ring capacity in periods, 0 when not in ring mode
+    PyRtRing *_outputRing;      // filled by python, drained by the callback
+    PyRtRing *_inputRing;       // filled by the callback, drained by python
+    unsigned long _underflows;  // periods the output ring could not fill completely
+    unsigned long _overflows;   // periods the input ring could not take completely
+    unsigned int _outputFrameBytes;
+    unsigned int _inputFrameBytes;
+    // sample layout of the open stream
+    RtAudioFormat _format;
+    unsigned int _outputChannels;
+    unsigned int _inputChannels;
+    int _planar;                // RTAUDIO_NONINTERLEAVED, channels follow each other
+    int _typed;                 // StreamBuffers export typed samples instead of bytes
+    // blocking read/write: one python thread per direction at a time,
+    // woken by the callback once it has moved a period through the ring
+    PyThread_type_lock _writeLock;
+    PyThread_type_lock _readLock;
+    sem_t _outputSem;
+    sem_t _inputSem;
+    int _outputWaiting;         // a writer sleeps on _outputSem
+    int _inputWaiting;          // a reader sleeps on _inputSem
+    long _waitNanos;            // how long a waiter sleeps before rechecking the stream
+    // serializes open/start/stop/abort/close, which give up the GIL midway
+    PyThread_type_lock _controlLock;
+    // callback invocation, only touched by the RtApi callback thread
+    int _fastCallback;          // keep a thread state and argument tuple across periods
+    PyThreadState *_threadState; // the callback thread's state while it is kept
+    PyGILState_STATE _gstate;
+    PyObject *_args;            // argument tuple reused from period to period
+    // set by stop/close to make the callback thread drop its thread state
+    int _retireThreadState;
+    int _retireWaiting;
+    sem_t _retireSem;
+    // deadline mode: the python callback runs on a worker thread
+    PyRtDeadline *_deadline;
+    RtAudioCallback _pythonCallback; // the callback the worker runs
+    // render-ahead mode: a worker runs it ahead of the device into the output ring
+    PyRtRenderAhead *_ahead;
+    // batch mode: the callback gets blocks of several periods
+    PyRtBatch *_batch;
+    // the callback may live in a subinterpreter of its own
+    PyThreadState *_interpreter; // the subinterpreter's initial thread state
+    // native file playback, see play_file
+    PyRtFile *_file;
+    // native recording, see record_file
+    PyRtRecorder *_recorder;
+    // the stream options of the open stream, as the device settled them
+    unsigned int _bufferFrames;
+    unsigned int _numberOfBuffers;
+    long _streamFlags;
+    long _priority;
+    PyObject *_streamName;
+    // set while autotune measures a trial stream
+    PyRtTune *_tune;
+    // how long the callback thread waits for the GIL, see get_stats
+    PyRtGilStats _gil;
+    // the timeline of the stream threads, see start_trace
+    PyRtTrace *_trace;
 } PyRtAudioObject;
 
 // format flags
@@ -50,8 +136,390 @@ static PyObject *PyRtAudio_SINT8;
 static PyObject *PyRtAudio_SINT16;
 static PyObject *PyRtAudio_SINT24;
 static PyObject *PyRtAudio_SINT32;
-//static PyObject *PyRtAudio_FLOAT32;
-//static PyObject *PyRtAudio_FLOAT64;
+static PyObject *PyRtAudio_FLOAT32;
+static PyObject *PyRtAudio_FLOAT64;
+
+// stream flags
+static PyObject *PyRtAudio_NONINTERLEAVED;
+static PyObject *PyRtAudio_MINIMIZE_LATENCY;
+static PyObject *PyRtAudio_HOG_DEVICE;
+static PyObject *PyRtAudio_SCHEDULE_REALTIME;
+static PyObject *PyRtAudio_ALSA_USE_DEFAULT;
+static PyObject *PyRtAudio_HUGE_PAGES;
+
+// the arguments of callbacks that take none
+static PyObject *PyRtAudio_noArgs;
+
+// start StreamBuffer implementation
+// A StreamBuffer exposes a piece of stream memory through the buffer
+// interface. In zero copy and in-place mode the callback receives ones that
+// point straight at the RtApi user buffers, which are only valid for the
+// duration of the callback. If python holds on to one the memory is handed
+// over to the object (see detachStreamObject below).
+static void
+PyRtAudioBuffer_dealloc(PyRtAudioBufferObject *self) {
+    if (self->_owned) RtAudio::freeUserBuffer(self->_buf);
+    self->_buf = NULL;
+
+    self->ob_type->tp_free((PyObject *) self);
+}
+
+static Py_ssize_t
+PyRtAudioBuffer_length(PyRtAudioBufferObject *self) {
+    return self->_len;
+}
+
+static int
+PyRtAudioBuffer_checkValid(PyRtAudioBufferObject *self) {
+    if (self->_buf) return 0;
+    PyErr_SetString(PyExc_BufferError, "The stream this buffer belonged to has been closed");
+    return -1;
+}
+
+static Py_ssize_t
+PyRtAudioBuffer_getreadbuffer(PyRtAudioBufferObject *self, Py_ssize_t segment, void **ptr) {
+    if (PyRtAudioBuffer_checkValid(self)) return -1;
+    if (segment != 0) {
+        PyErr_SetString(PyExc_SystemError, "Accessing non-existent buffer segment");
+        return -1;
+    }
+    *ptr = self->_buf;
+    return self->_len;
+}
+
+static Py_ssize_t
+PyRtAudioBuffer_getwritebuffer(PyRtAudioBufferObject *self, Py_ssize_t segment, void **ptr) {
+    if (self->_readonly) {
+        PyErr_SetString(PyExc_TypeError, "Stream buffer is read-only");
+        return -1;
+    }
+    return PyRtAudioBuffer_getreadbuffer(self, segment, ptr);
+}
+
+static Py_ssize_t
+PyRtAudioBuffer_getsegcount(PyRtAudioBufferObject *self, Py_ssize_t *lenp) {
+    if (lenp) *lenp = self->_len;
+    return 1;
+}
+
+// exports the samples with their format and (frames, channels) shape, or
+// (channels, frames) for non-interleaved streams, so numpy.asarray() gets
+// a correctly typed and shaped array without any copy
+static int
+PyRtAudioBuffer_getbuffer(PyRtAudioBufferObject *self, Py_buffer *view, int flags) {
+    if (PyRtAudioBuffer_checkValid(self)) return -1;
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE && self->_readonly) {
+        PyErr_SetString(PyExc_BufferError, "Stream buffer is read-only");
+        return -1;
+    }
+
+    Py_INCREF(self);
+    view->obj = (PyObject *) self;
+    view->buf = self->_buf;
+    view->len = self->_len;
+    view->readonly = self->_readonly;
+    view->itemsize = self->_itemsize;
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char *) self->_format : NULL;
+    view->ndim = self->_ndim;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->_shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->_strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PySequenceMethods PyRtAudioBuffer_as_sequence = {
+    (lenfunc) PyRtAudioBuffer_length,   //sq_length
+};
+
+static PyBufferProcs PyRtAudioBuffer_as_buffer = {
+    (readbufferproc) PyRtAudioBuffer_getreadbuffer,     //bf_getreadbuffer
+    (writebufferproc) PyRtAudioBuffer_getwritebuffer,   //bf_getwritebuffer
+    (segcountproc) PyRtAudioBuffer_getsegcount,         //bf_getsegcount
+    (charbufferproc) PyRtAudioBuffer_getreadbuffer,     //bf_getcharbuffer
+    (getbufferproc) PyRtAudioBuffer_getbuffer,          //bf_getbuffer
+    0,                                                  //bf_releasebuffer
+};
+
+// StreamBuffer type definition
+static PyTypeObject pyrtaudio_PyRtAudioBufferType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  //ob_size
+    "pyrtaudio.StreamBuffer",           //tp_name
+    sizeof(PyRtAudioBufferObject),      //tp_basicsize
+    0,                                  //tp_itemsize
+    (destructor) PyRtAudioBuffer_dealloc, //tp_dealloc
+    0,                                  //tp_print
+    0,                                  //tp_getattr
+    0,                                  //tp_setattr
+    0,                                  //tp_compare
+    0,                                  //tp_repr
+    0,                                  //tp_as_number
+    &PyRtAudioBuffer_as_sequence,       //tp_as_sequence
+    0,                                  //tp_as_mapping
+    0,                                  //tp_hash
+    0,                                  //tp_call
+    0,                                  //tp_str
+    0,                                  //tp_getattro
+    0,                                  //tp_setattro
+    &PyRtAudioBuffer_as_buffer,         //tp_as_buffer
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, //tp_flags
+    "Audio stream memory exposed through the buffer interface", //tp_doc
+};
+
+static PyRtAudioBufferObject *
+newStreamBuffer(Py_ssize_t len, int readonly) {
+    PyRtAudioBufferObject *buffer = PyObject_New(PyRtAudioBufferObject,
+            &pyrtaudio_PyRtAudioBufferType);
+    if (!buffer) return NULL;
+    buffer->_buf = NULL;
+    buffer->_len = len;
+    buffer->_readonly = readonly;
+    buffer->_owned = 0;
+    // plain bytes until described
+    buffer->_format = "B";
+    buffer->_itemsize = 1;
+    buffer->_ndim = 1;
+    buffer->_shape[0] = len;
+    buffer->_strides[0] = 1;
+    return buffer;
+}
+
+// both layouts are C-contiguous in their own shape
+static void
+describeStreamBuffer(PyRtAudioBufferObject *buffer, RtAudioFormat format,
+        unsigned int channels, int planar) {
+    Py_ssize_t width = widthFromFormat(format);
+    Py_ssize_t frames = buffer->_len / (width * channels);
+    buffer->_format = formatCodeFromFormat(format);
+    buffer->_itemsize = width;
+    buffer->_ndim = 2;
+    buffer->_shape[0] = planar ? channels : frames;
+    buffer->_shape[1] = planar ? frames : channels;
+    buffer->_strides[0] = buffer->_shape[1] * width;
+    buffer->_strides[1] = width;
+}
+
+// end StreamBuffer implementation
+
+// point a (reused) wrapper at the stream buffer for this period
+static int getStreamObject(PyRtAudioObject *self, PyRtAudioBufferObject **wrapper,
+        void *buffer, unsigned long len, unsigned int channels, int readonly, PyObject **obj) {
+    // the wrapper is reused from period to period until python keeps one
+    if (!*wrapper) {
+        *wrapper = newStreamBuffer(len, readonly);
+        if (!*wrapper) return 2;
+        if (self->_typed)
+            describeStreamBuffer(*wrapper, self->_format, channels, self->_planar);
+    }
+    (*wrapper)->_buf = (char *) buffer;
+    Py_INCREF(*wrapper);
+    *obj = (PyObject *) *wrapper;
+    return 0;
+}
+
+// wrap (zero copy mode) or copy the stream input buffer for the callback
+static int getInputObject(PyRtAudioObject *self, void *inputBuffer, PyObject **obj) {
+    if (!self->_zeroCopy)
+        return getByteArray(obj, inputBuffer, self->_expectedInputBufferLength);
+    return getStreamObject(self, &self->_inputBuffer, inputBuffer,
+            self->_expectedInputBufferLength, self->_inputChannels, 1, obj);
+}
+
+// in deadline, render-ahead and batch mode the callback works on the
+// worker's or the batch buffers instead
+static char *exchangeStreamBuffer(PyRtAudioObject *self, bool input, char *fresh) {
+    char **slot;
+    if (self->_deadline)
+        slot = input ? &self->_deadline->in : &self->_deadline->out;
+    else if (self->_batch)
+        slot = input ? &self->_batch->in : &self->_batch->out;
+    else if (self->_ahead && !input)
+        slot = &self->_ahead->block;
+    else
+        return self->_rt->exchangeUserBuffer(input, fresh);
+    char *old = *slot;
+    *slot = fresh;
+    return old;
+}
+
+// RtAudio's own buffers are replaced by locked blocks like the arena they
+// came from, the workers' and the batch buffers by plain ones, which they
+// free() themselves
+static char *allocateStreamBuffer(PyRtAudioObject *self, bool input, size_t len) {
+    if (self->_deadline || self->_batch || (self->_ahead && !input))
+        return (char *) malloc(len);
+    return RtAudio::allocateUserBuffer(len);
+}
+
+// Must be called after the callback returned and every temporary reference
+// to the wrapper is gone. If python kept it (stored it, or a memoryview or
+// array made from it) the wrapped memory is handed over to the wrapper and
+// RtAudio gets a fresh buffer for the following periods. For output the
+// samples just written are carried over, since RtAudio has yet to play
+// them. This is the only case in which the wrappers allocate inside the
+// callback.
+static int detachStreamObject(PyRtAudioObject *self, PyRtAudioBufferObject **wrapper,
+        bool input) {
+    PyRtAudioBufferObject *buffer = *wrapper;
+    if (!buffer || Py_REFCNT(buffer) == 1)
+        return 0;
+
+    char *fresh = allocateStreamBuffer(self, input, buffer->_len);
+    if (!fresh) {
+        PyErr_NoMemory();
+        PyErr_Print();
+        return 2;
+    }
+    if (!input) memcpy(fresh, buffer->_buf, buffer->_len);
+    buffer->_buf = exchangeStreamBuffer(self, input, fresh);
+    buffer->_owned = 1;
+    *wrapper = NULL;
+    Py_DECREF(buffer);
+    return 0;
+}
+
+// invalidate a wrapper before the stream memory goes away
+static void releaseStreamObject(PyRtAudioBufferObject **wrapper) {
+    PyRtAudioBufferObject *buffer = *wrapper;
+    if (!buffer) return;
+    *wrapper = NULL;
+    if (!buffer->_owned) {
+        buffer->_buf = NULL;
+        buffer->_len = 0;
+    }
+    Py_DECREF(buffer);
+}
+
+static void releaseStreamObjects(PyRtAudioObject *self) {
+    releaseStreamObject(&self->_inputBuffer);
+    releaseStreamObject(&self->_outputBuffer);
+}
+
+// The callbacks run on a thread python knows nothing about. In the legacy
+// mode every period goes through PyGILState_Ensure/Release, which creates
+// and destroys a thread state each time. In fast mode the thread state made
+// on the first period is kept and only the GIL is released between periods.
+// A thread state has to be dropped by the thread that created it, so
+// stop_stream and close_stream ask the callback to do so and wait for it
+// (see retireThreadState); a callback that stops the stream itself drops
+// it right away. The PyGILState functions only know the main interpreter,
+// so a callback in a subinterpreter manages its thread state by hand.
+static void enterInterpreter(PyRtAudioObject *self) {
+    traceRecord(self->_trace, PYRT_TRACE_GIL_WAIT, RTAUDIO_TRACE_BEGIN);
+    unsigned long long start = statsNanos();
+    if (self->_threadState) {
+        PyEval_RestoreThread(self->_threadState);
+    } else {
+        if (self->_interpreter)
+            PyEval_RestoreThread(PyThreadState_New(self->_interpreter->interp));
+        else
+            self->_gstate = PyGILState_Ensure();
+        if (self->_fastCallback && !__atomic_load_n(&self->_retireThreadState, __ATOMIC_ACQUIRE))
+            __atomic_store_n(&self->_threadState, PyThreadState_Get(), __ATOMIC_RELEASE);
+    }
+    gilStatsAdd(&self->_gil, statsNanos() - start);
+    traceRecord(self->_trace, PYRT_TRACE_GIL_WAIT, RTAUDIO_TRACE_END);
+    traceRecord(self->_trace, PYRT_TRACE_GIL_HELD, RTAUDIO_TRACE_BEGIN);
+    // tells GIL stalls apart from slow callbacks in deadline mode
+    if (self->_deadline)
+        __atomic_store_n(&self->_deadline->gilAcquired, 1, __ATOMIC_RELEASE);
+}
+
+static void leaveInterpreter(PyRtAudioObject *self, int retcode) {
+    traceRecord(self->_trace, PYRT_TRACE_GIL_HELD, RTAUDIO_TRACE_END);
+    int retire = __atomic_load_n(&self->_retireThreadState, __ATOMIC_ACQUIRE);
+    if (self->_threadState && !retcode && !retire) {
+        PyEval_SaveThread();
+        return;
+    }
+    int kept = self->_threadState != NULL;
+    __atomic_store_n(&self->_threadState, (PyThreadState *) NULL, __ATOMIC_RELEASE);
+    if (self->_interpreter) {
+        PyThreadState_Clear(PyThreadState_Get());
+        PyThreadState_DeleteCurrent();
+    } else {
+        PyGILState_Release(self->_gstate);
+    }
+    if (kept && __atomic_exchange_n(&self->_retireWaiting, 0, __ATOMIC_ACQ_REL))
+        sem_post(&self->_retireSem);
+}
+
+// Called with the GIL held before the stream is stopped or closed. Waits
+// a few periods at most; should the callback not come around in time the
+// thread state is left alone, which leaks it but keeps it valid.
+static void retireThreadState(PyRtAudioObject *self) {
+    __atomic_store_n(&self->_retireThreadState, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&self->_retireWaiting, 1, __ATOMIC_SEQ_CST);
+
+    int posted = 0;
+    if (__atomic_load_n(&self->_threadState, __ATOMIC_ACQUIRE) && self->_rt->isStreamRunning()) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        Py_BEGIN_ALLOW_THREADS
+        while ((posted = !sem_timedwait(&self->_retireSem, &deadline)) == 0 && errno == EINTR)
+            ;
+        Py_END_ALLOW_THREADS
+    }
+
+    // if the callback claimed the wakeup after all, take its post so the
+    // next wait does not return early
+    if (!posted && !__atomic_exchange_n(&self->_retireWaiting, 0, __ATOMIC_ACQ_REL)) {
+        Py_BEGIN_ALLOW_THREADS
+        sem_wait(&self->_retireSem);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+// Packs the callback arguments. In fast mode the tuple of the previous
+// period is refilled unless python kept a reference to it.
+static int getCallbackArgs(PyRtAudioObject *self, PyObject **args,
+        PyObject *first, PyObject *second) {
+    if (!self->_fastCallback) {
+        *args = second ? Py_BuildValue("(OO)", first, second) : Py_BuildValue("(O)", first);
+        return *args ? 0 : 2;
+    }
+
+    Py_ssize_t n = second ? 2 : 1;
+    if (!self->_args || Py_REFCNT(self->_args) != 1 || PyTuple_GET_SIZE(self->_args) != n) {
+        Py_XDECREF(self->_args);
+        self->_args = PyTuple_New(n);
+        if (!self->_args) return 2;
+    }
+    Py_INCREF(first);
+    PyTuple_SET_ITEM(self->_args, 0, first);
+    if (second) {
+        Py_INCREF(second);
+        PyTuple_SET_ITEM(self->_args, 1, second);
+    }
+    Py_INCREF(self->_args);
+    *args = self->_args;
+    return 0;
+}
+
+// Drops the arguments again. The cached tuple is emptied so it does not
+// keep the stream buffers alive, which detachStreamObject would mistake for
+// python keeping them.
+static void releaseCallbackArgs(PyRtAudioObject *self, PyObject *args) {
+    if (args == self->_args && Py_REFCNT(args) == 2) {
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(args); i++) {
+            Py_CLEAR(PyTuple_GET_ITEM(args, i));
+        }
+    }
+    Py_DECREF(args);
+}
+
+static PyObject *callCallback(PyRtAudioObject *self, PyObject *args) {
+    PyObject *result;
+    traceRecord(self->_trace, PYRT_TRACE_PYTHON, RTAUDIO_TRACE_BEGIN);
+    if (!self->_fastCallback)
+        result = PyEval_CallObject(self->_cb, args);
+    else // skips the argument checks of PyEval_CallObjectWithKeywords
+        result = PyObject_Call(self->_cb, args ? args : PyRtAudio_noArgs, NULL);
+    traceRecord(self->_trace, PYRT_TRACE_PYTHON, RTAUDIO_TRACE_END);
+    return result;
+}
 
 // this function is called by RtAudio when operating in render-only mode
 static int __pyrtaudio_renderCallback(void *outputBuffer, void *inputBuffer,
@@ -61,12 +529,15 @@ static int __pyrtaudio_renderCallback(void *outputBuffer, void *inputBuffer,
     PyObject *result;
     Py_buffer *view;
 
-    PYGILSTATE_ACQUIRE;
     PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    enterInterpreter(self);
     view = self->_outputView;
 
     // call the user specified callback
-    result = PyEval_CallObject(self->_cb, NULL);
+    result = callCallback(self, NULL);
+    retcode = checkResult(result);
+    if (retcode) goto cleanup_no_result;
+
     retcode = isNone(result);
     if (retcode) goto cleanup_none_returned;
 
@@ -79,11 +550,15 @@ static int __pyrtaudio_renderCallback(void *outputBuffer, void *inputBuffer,
     if (retcode) goto cleanup_could_not_extract;
 
     // check length sanity
+    // arrays must match the sample format and the buffer layout
+    retcode = checkLayout(view, self->_format, self->_outputChannels, self->_planar);
+    if (retcode) goto cleanup_unexpected_length;
+
     retcode = checkLength(self->_expectedOutputBufferLength, view->len);
     if (retcode) goto cleanup_unexpected_length;
 
-    // fill output buffer
-    memcpy(outputBuffer, view->buf, view->len);
+    // fill output buffer, gathering strided and fortran ordered arrays
+    copyFromBuffer(outputBuffer, view);
 
     // cleanup
     cleanup_unexpected_length:
@@ -92,7 +567,8 @@ static int __pyrtaudio_renderCallback(void *outputBuffer, void *inputBuffer,
     cleanup_not_a_buffer:
     cleanup_none_returned:
     Py_DECREF(result);
-    PYGILSTATE_RELEASE;
+    cleanup_no_result:
+    leaveInterpreter(self, retcode);
     // no need to free the memory used by view since it's allocated on
     // instantiation of the RtAudio class in Python and freed on deallocation
     return retcode;
@@ -104,34 +580,38 @@ static int __pyrtaudio_captureCallback(void *outputBuffer, void *inputBuffer,
         void *userData) {
     int retcode = 0;
     PyObject *result = NULL;
-    PyObject *bytearray = NULL;
+    PyObject *input = NULL;
     PyObject *arglist = NULL;
 
-    PYGILSTATE_ACQUIRE;
     PyRtAudioObject *self = (PyRtAudioObject *) userData;
-    // creating the byte array with the actual input buffer is
-    // safe since PyByteArray_FromStringAndSize performs a memcpy
-    // (bytearrayobject.c:147)
-    // which also means that DECREF:ing the bytearray won't touch
-    // our output buffer
-    retcode = getByteArray(&bytearray, inputBuffer, 
-            self->_expectedInputBufferLength);
-    if (retcode) goto cleanup_no_bytearray;
-
-    // pack the bytearray into an argument list
-    retcode = getArgList(&arglist, &bytearray);
+    enterInterpreter(self);
+    // in copy mode the input object is a byte array created with
+    // PyByteArray_FromStringAndSize, which performs a memcpy
+    // (bytearrayobject.c:147), so DECREF:ing it won't touch our buffer.
+    // in zero copy mode it wraps the buffer itself, see detachStreamObject
+    retcode = getInputObject(self, inputBuffer, &input);
+    if (retcode) goto cleanup_no_input;
+
+    // pack the input object into an argument list
+    retcode = getCallbackArgs(self, &arglist, input, NULL);
     if (retcode) goto cleanup_no_arglist;
 
     // call the python function
-    result = PyEval_CallObject(self->_cb, arglist);
+    result = callCallback(self, arglist);
+    retcode = checkResult(result);
+    if (retcode) goto cleanup_no_result;
+
     retcode = isNone(result);
 
     Py_DECREF(result);
-    Py_DECREF(arglist);
+    cleanup_no_result:
+    releaseCallbackArgs(self, arglist);
     cleanup_no_arglist:
-    Py_DECREF(bytearray);
-    cleanup_no_bytearray:
-    PYGILSTATE_RELEASE;
+    Py_DECREF(input);
+    if (self->_zeroCopy && detachStreamObject(self, &self->_inputBuffer, true))
+        retcode = 2;
+    cleanup_no_input:
+    leaveInterpreter(self, retcode);
     return retcode;
 }
 
@@ -141,294 +621,2403 @@ static int __pyrtaudio_duplexCallback(void *outputBuffer, void *inputBuffer,
         void *userData) {
     int retcode = 0;
     PyObject *result = NULL;
-    PyObject *bytearray = NULL;
+    PyObject *input = NULL;
     PyObject *arglist = NULL;
     Py_buffer *view = NULL;
 
-    PYGILSTATE_ACQUIRE;
-
     PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    enterInterpreter(self);
     view = self->_outputView;
 
-    retcode = getByteArray(&bytearray, inputBuffer, 
-            self->_expectedInputBufferLength);
-    if (retcode) goto cleanup_no_bytearray;
+    retcode = getInputObject(self, inputBuffer, &input);
+    if (retcode) goto cleanup_no_input;
+
+    retcode = getCallbackArgs(self, &arglist, input, NULL);
+    if (retcode) goto cleanup_no_arglist;
+
+    result = callCallback(self, arglist);
+    retcode = checkResult(result);
+    if (retcode) goto cleanup_no_result;
+
+    retcode = isNone(result);
+    if (retcode) goto cleanup_none_returned;
+
+    retcode = isBuffer(result);
+    if (retcode) goto cleanup_not_a_buffer;
+
+    retcode = getBuffer(result, &view);
+    if (retcode) goto cleanup_could_not_extract;
+
+    // arrays must match the sample format and the buffer layout
+    retcode = checkLayout(view, self->_format, self->_outputChannels, self->_planar);
+    if (retcode) goto cleanup_unexpected_length;
+
+    retcode = checkLength(self->_expectedOutputBufferLength, view->len);
+    if (retcode) goto cleanup_unexpected_length;
+
+    // gathers strided and fortran ordered arrays, plain memcpy otherwise
+    copyFromBuffer(outputBuffer, view);
+
+    cleanup_unexpected_length:
+    PyBuffer_Release(view);
+    cleanup_could_not_extract:
+    cleanup_not_a_buffer:
+    cleanup_none_returned:
+    Py_DECREF(result);
+    cleanup_no_result:
+    releaseCallbackArgs(self, arglist);
+    cleanup_no_arglist:
+    Py_DECREF(input);
+    if (self->_zeroCopy && detachStreamObject(self, &self->_inputBuffer, true))
+        retcode = 2;
+    cleanup_no_input:
+    leaveInterpreter(self, retcode);
+    return retcode;
+}
+
+// In in-place mode the callback gets a writable StreamBuffer wrapping the
+// RtApi output buffer and fills it itself, e.g. with numpy.copyto() or
+// readinto(). Its return value is interpreted like the one of a native
+// RtAudioCallback: None or 0 continues, 1 stops and 2 aborts the stream.
+
+// this function is called by RtAudio when operating in render-only mode
+static int __pyrtaudio_renderInPlaceCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    int retcode = 0;
+    PyObject *result = NULL;
+    PyObject *output = NULL;
+    PyObject *arglist = NULL;
+
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    enterInterpreter(self);
+
+    retcode = getStreamObject(self, &self->_outputBuffer, outputBuffer,
+            self->_expectedOutputBufferLength, self->_outputChannels, 0, &output);
+    if (retcode) goto cleanup_no_output;
+
+    retcode = getCallbackArgs(self, &arglist, output, NULL);
+    if (retcode) goto cleanup_no_arglist;
+
+    result = callCallback(self, arglist);
+    retcode = checkResult(result);
+    if (retcode) goto cleanup_no_result;
+
+    retcode = getReturnCode(result);
+
+    Py_DECREF(result);
+    cleanup_no_result:
+    releaseCallbackArgs(self, arglist);
+    cleanup_no_arglist:
+    Py_DECREF(output);
+    if (detachStreamObject(self, &self->_outputBuffer, false)) retcode = 2;
+    cleanup_no_output:
+    leaveInterpreter(self, retcode);
+    return retcode;
+}
+
+// this function is called by RtAudio when operating in duplex mode
+static int __pyrtaudio_duplexInPlaceCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    int retcode = 0;
+    PyObject *result = NULL;
+    PyObject *input = NULL;
+    PyObject *output = NULL;
+    PyObject *arglist = NULL;
+
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    enterInterpreter(self);
+
+    retcode = getInputObject(self, inputBuffer, &input);
+    if (retcode) goto cleanup_no_input;
+
+    retcode = getStreamObject(self, &self->_outputBuffer, outputBuffer,
+            self->_expectedOutputBufferLength, self->_outputChannels, 0, &output);
+    if (retcode) goto cleanup_no_output;
+
+    retcode = getCallbackArgs(self, &arglist, input, output);
+    if (retcode) goto cleanup_no_arglist;
+
+    result = callCallback(self, arglist);
+    retcode = checkResult(result);
+    if (retcode) goto cleanup_no_result;
+
+    retcode = getReturnCode(result);
+
+    Py_DECREF(result);
+    cleanup_no_result:
+    releaseCallbackArgs(self, arglist);
+    cleanup_no_arglist:
+    Py_DECREF(output);
+    if (detachStreamObject(self, &self->_outputBuffer, false)) retcode = 2;
+    cleanup_no_output:
+    Py_DECREF(input);
+    if (detachStreamObject(self, &self->_inputBuffer, true)) retcode = 2;
+    cleanup_no_input:
+    leaveInterpreter(self, retcode);
+    return retcode;
+}
+
+// In ring mode the callback never enters the interpreter. It only moves
+// audio between the device buffers and two preallocated lock-free rings
+// which python threads fill and drain (see ring_write and ring_read).
+static int __pyrtaudio_ringCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+
+    if (self->_outputRing) {
+        size_t len = self->_expectedOutputBufferLength;
+        size_t got = ringRead(self->_outputRing, outputBuffer, len);
+        if (got < len) {
+            memset((char *) outputBuffer + got, 0, len - got);
+            __atomic_fetch_add(&self->_underflows, 1, __ATOMIC_RELAXED);
+        }
+        // sem_post is async-signal-safe and never blocks
+        if (__atomic_exchange_n(&self->_outputWaiting, 0, __ATOMIC_ACQ_REL))
+            sem_post(&self->_outputSem);
+    }
+
+    if (self->_inputRing) {
+        size_t len = self->_expectedInputBufferLength;
+        if (ringWrite(self->_inputRing, inputBuffer, len) < len)
+            __atomic_fetch_add(&self->_overflows, 1, __ATOMIC_RELAXED);
+        if (__atomic_exchange_n(&self->_inputWaiting, 0, __ATOMIC_ACQ_REL))
+            sem_post(&self->_inputSem);
+    }
+
+    return 0;
+}
+
+// wakes up blocked readers and writers so they notice the stream stopped
+static void wakeRingWaiters(PyRtAudioObject *self) {
+    if (__atomic_exchange_n(&self->_outputWaiting, 0, __ATOMIC_ACQ_REL))
+        sem_post(&self->_outputSem);
+    if (__atomic_exchange_n(&self->_inputWaiting, 0, __ATOMIC_ACQ_REL))
+        sem_post(&self->_inputSem);
+}
+
+// takes one of the object's locks, giving up the GIL if another thread holds it
+static void acquireLock(PyThread_type_lock lock) {
+    if (PyThread_acquire_lock(lock, NOWAIT_LOCK)) return;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+}
+
+// Sleeps without the GIL until the callback has moved another period or
+// the wait times out. Returns -1 if a signal handler raised.
+static int waitForRing(PyRtAudioObject *self, sem_t *sem, int *waiting) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += self->_waitNanos;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+
+    Py_BEGIN_ALLOW_THREADS
+    while (sem_timedwait(sem, &deadline) && errno == EINTR)
+        ;
+    Py_END_ALLOW_THREADS
+    __atomic_store_n(waiting, 0, __ATOMIC_RELEASE);
+
+    return PyErr_CheckSignals();
+}
+
+// Copies whole frames into the output ring, waiting for space if block is
+// set. Stops short once the stream is not running and the ring is full.
+// Must be called with the write lock held. Returns -1 on error.
+static Py_ssize_t ringWriteFrames(PyRtAudioObject *self, char const *src, size_t len, int block) {
+    PyRtRing *ring = self->_outputRing;
+    unsigned int frameBytes = self->_outputFrameBytes;
+    size_t done = 0;
+
+    while (1) {
+        size_t n = ringWriteAvailable(ring);
+        n -= n % frameBytes;
+        if (n > len - done) n = len - done;
+        if (n) {
+            Py_BEGIN_ALLOW_THREADS
+            ringWrite(ring, src + done, n);
+            Py_END_ALLOW_THREADS
+            done += n;
+        }
+        if (done == len || !block) break;
+
+        // publish the waiter before rechecking so a post cannot be missed
+        __atomic_store_n(&self->_outputWaiting, 1, __ATOMIC_SEQ_CST);
+        if (ringWriteAvailable(ring) >= frameBytes) continue;
+        if (!self->_rt->isStreamRunning()) {
+            __atomic_store_n(&self->_outputWaiting, 0, __ATOMIC_RELEASE);
+            break;
+        }
+        if (waitForRing(self, &self->_outputSem, &self->_outputWaiting)) return -1;
+    }
+
+    return done / frameBytes;
+}
+
+// The input counterpart of ringWriteFrames. Must be called with the read
+// lock held.
+static Py_ssize_t ringReadFrames(PyRtAudioObject *self, char *dst, size_t len, int block) {
+    PyRtRing *ring = self->_inputRing;
+    unsigned int frameBytes = self->_inputFrameBytes;
+    size_t done = 0;
+
+    len -= len % frameBytes;
+    while (1) {
+        size_t n = ringReadAvailable(ring);
+        if (n > len - done) n = len - done;
+        if (n) {
+            Py_BEGIN_ALLOW_THREADS
+            ringRead(ring, dst + done, n);
+            Py_END_ALLOW_THREADS
+            done += n;
+        }
+        if (done == len || !block) break;
+
+        __atomic_store_n(&self->_inputWaiting, 1, __ATOMIC_SEQ_CST);
+        if (ringReadAvailable(ring)) continue;
+        if (!self->_rt->isStreamRunning()) {
+            __atomic_store_n(&self->_inputWaiting, 0, __ATOMIC_RELEASE);
+            break;
+        }
+        if (waitForRing(self, &self->_inputSem, &self->_inputWaiting)) return -1;
+    }
+
+    return done / frameBytes;
+}
+
+// only called while the callback is not running
+static void releaseRings(PyRtAudioObject *self) {
+    ringDestroy(self->_outputRing);
+    ringDestroy(self->_inputRing);
+    self->_outputRing = NULL;
+    self->_inputRing = NULL;
+}
+
+static int allocateRings(PyRtAudioObject *self, int output, int input) {
+    // the depth is bounded, the size of a period in bytes is not
+    if ((output && self->_expectedOutputBufferLength > SIZE_MAX / self->_ringDepth) ||
+            (input && self->_expectedInputBufferLength > SIZE_MAX / self->_ringDepth)) {
+        PyErr_SetString(PyExc_ValueError, "ring_depth is too large for the buffer size");
+        return 2;
+    }
+    if (output) {
+        self->_outputRing = ringCreate(self->_ringDepth * self->_expectedOutputBufferLength);
+        if (!self->_outputRing) goto fail;
+    }
+    if (input) {
+        self->_inputRing = ringCreate(self->_ringDepth * self->_expectedInputBufferLength);
+        if (!self->_inputRing) goto fail;
+    }
+    self->_underflows = 0;
+    self->_overflows = 0;
+    return 0;
+
+    fail:
+    releaseRings(self);
+    PyErr_NoMemory();
+    return 2;
+}
+
+// The worker thread of deadline mode. It runs the regular python callback
+// on its own buffers, one job per period handed over by the callback below.
+static void *deadlineWorker(void *ptr) {
+    PyRtAudioObject *self = (PyRtAudioObject *) ptr;
+    PyRtDeadline *d = self->_deadline;
+
+    while (1) {
+        while (sem_wait(&d->jobSem) && errno == EINTR)
+            ;
+        if (__atomic_load_n(&d->quit, __ATOMIC_ACQUIRE)) break;
+
+        d->retcode = self->_pythonCallback(d->out, d->inLen ? d->in : NULL,
+                d->frames, d->streamTime, d->status, self);
+        __atomic_store_n(&d->state, PYRT_JOB_DONE, __ATOMIC_RELEASE);
+        sem_post(&d->doneSem);
+    }
+    return NULL;
+}
+
+static void deadlineMiss(PyRtDeadline *d, double streamTime) {
+    int kind = __atomic_load_n(&d->gilAcquired, __ATOMIC_ACQUIRE) ? PYRT_MISS_CALLBACK : PYRT_MISS_GIL;
+    __atomic_fetch_add(&d->misses, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(kind == PYRT_MISS_GIL ? &d->gilMisses : &d->callbackMisses, 1, __ATOMIC_RELAXED);
+    deadlineLog(d, streamTime, kind);
+}
+
+// this function is called by RtAudio when operating in deadline mode
+static int __pyrtaudio_deadlineCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    PyRtDeadline *d = self->_deadline;
+    char *output = (char *) outputBuffer;
+
+    __atomic_fetch_add(&d->periods, 1, __ATOMIC_RELAXED);
+    if (status) {
+        __atomic_fetch_add(&d->xruns, 1, __ATOMIC_RELAXED);
+        deadlineLog(d, streamTime, PYRT_MISS_XRUN);
+    }
+
+    int state = __atomic_load_n(&d->state, __ATOMIC_ACQUIRE);
+    if (state == PYRT_JOB_DONE) {
+        // a late result came in since the last period
+        while (sem_wait(&d->doneSem) && errno == EINTR)
+            ;
+        __atomic_store_n(&d->state, PYRT_JOB_IDLE, __ATOMIC_RELAXED);
+        if (d->playLate) {
+            // play it now and skip this period's call, nothing is lost
+            __atomic_fetch_add(&d->latePlayed, 1, __ATOMIC_RELAXED);
+            deadlineDeliver(d, output);
+            return d->retcode;
+        }
+        __atomic_fetch_add(&d->lateDropped, 1, __ATOMIC_RELAXED);
+        // a stop or abort request is honoured even if the samples are not
+        if (d->retcode) {
+            deadlineConceal(d, output);
+            return d->retcode;
+        }
+    } else if (state == PYRT_JOB_RUNNING) {
+        // still busy with a job that already missed its deadline
+        deadlineMiss(d, streamTime);
+        deadlineConceal(d, output);
+        return 0;
+    }
+
+    if (inputBuffer) memcpy(d->in, inputBuffer, d->inLen);
+    d->streamTime = streamTime;
+    d->status = status;
+    __atomic_store_n(&d->gilAcquired, 0, __ATOMIC_RELAXED);
+
+    struct timespec start;
+    clock_gettime(CLOCK_REALTIME, &start);
+    __atomic_store_n(&d->state, PYRT_JOB_RUNNING, __ATOMIC_RELEASE);
+    sem_post(&d->jobSem);
+
+    if (!deadlineWait(d, &start)) {
+        __atomic_store_n(&d->state, PYRT_JOB_IDLE, __ATOMIC_RELAXED);
+        deadlineDeliver(d, output);
+        return d->retcode;
+    }
+
+    deadlineMiss(d, streamTime);
+    deadlineConceal(d, output);
+    return 0;
+}
+
+// joins the worker, which may need the GIL to finish a job first
+static void stopDeadlineWorker(PyRtAudioObject *self) {
+    PyRtDeadline *d = self->_deadline;
+    if (!d || !d->running) return;
+    __atomic_store_n(&d->quit, 1, __ATOMIC_RELEASE);
+    sem_post(&d->jobSem);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(d->worker, NULL);
+    Py_END_ALLOW_THREADS
+    d->running = 0;
+}
+
+// only after the worker stopped and the stream objects were released
+static void releaseDeadline(PyRtAudioObject *self) {
+    deadlineDestroy(self->_deadline);
+    self->_deadline = NULL;
+}
+
+static int startDeadlineWorker(PyRtAudioObject *self, unsigned long inputLength,
+        unsigned int frames, unsigned int rate, double share, int concealment, int playLate) {
+    PyRtDeadline *d = deadlineCreate(inputLength, self->_expectedOutputBufferLength, frames,
+            self->_outputChannels, self->_format, self->_planar);
+    if (!d) {
+        PyErr_NoMemory();
+        return 2;
+    }
+    d->budgetNanos = share * 1e9 * frames / rate;
+    d->concealment = concealment;
+    d->playLate = playLate;
+    self->_deadline = d;
+
+    if (pthread_create(&d->worker, NULL, deadlineWorker, self)) {
+        releaseDeadline(self);
+        PyErr_SetString(PyExc_RuntimeError, "Could not start the deadline worker thread");
+        return 2;
+    }
+    d->running = 1;
+    return 0;
+}
+
+// The worker thread of render-ahead mode. It renders periods into the
+// output ring until the target number of them is queued, then sleeps until
+// the callback below takes one. Stream time is that of the period in the
+// rendered sequence, which is when it is played if nothing underflows.
+static void *renderAheadWorker(void *ptr) {
+    PyRtAudioObject *self = (PyRtAudioObject *) ptr;
+    PyRtRenderAhead *a = self->_ahead;
+    PyRtRing *ring = self->_outputRing;
+    size_t len = self->_expectedOutputBufferLength;
+
+    while (!__atomic_load_n(&a->quit, __ATOMIC_ACQUIRE)) {
+        // a stopped stream may not call again for a while, so the thread
+        // state is dropped here rather than in the next callback
+        if (self->_threadState && __atomic_load_n(&self->_retireThreadState, __ATOMIC_ACQUIRE)) {
+            enterInterpreter(self);
+            leaveInterpreter(self, 2);
+        }
+
+        size_t queued = ring->size - ringWriteAvailable(ring);
+        unsigned int target = __atomic_load_n(&a->target, __ATOMIC_ACQUIRE);
+        if (!__atomic_load_n(&a->retcode, __ATOMIC_ACQUIRE) && queued < target * len) {
+            int retcode = self->_pythonCallback(a->block, NULL, a->frames,
+                    a->produced * a->period, 0, self);
+            // the period is played before a stop takes effect, but not an abort
+            if (retcode != 2) ringWrite(ring, a->block, len);
+            a->produced++;
+            if (retcode) __atomic_store_n(&a->retcode, retcode, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // publish the waiter before rechecking so a post cannot be missed
+        __atomic_store_n(&self->_outputWaiting, 1, __ATOMIC_SEQ_CST);
+        if (ring->size - ringWriteAvailable(ring) < queued) continue;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += self->_waitNanos;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (sem_timedwait(&self->_outputSem, &deadline) && errno == EINTR)
+            ;
+        __atomic_store_n(&self->_outputWaiting, 0, __ATOMIC_RELEASE);
+    }
+
+    if (self->_threadState) {
+        enterInterpreter(self);
+        leaveInterpreter(self, 2);
+    }
+    return NULL;
+}
+
+// this function is called by RtAudio when operating in render-ahead mode
+static int __pyrtaudio_renderAheadCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    // the worker publishes its last period before the return code
+    int retcode = __atomic_load_n(&self->_ahead->retcode, __ATOMIC_ACQUIRE);
+    if (retcode == 2) {
+        memset(outputBuffer, 0, self->_expectedOutputBufferLength);
+        return 2;
+    }
+
+    __pyrtaudio_ringCallback(outputBuffer, inputBuffer, frames, streamTime, status, userData);
+
+    // a stop requested by the callback waits for the queue to play out
+    if (retcode == 1 && !ringReadAvailable(self->_outputRing))
+        return 1;
+    return 0;
+}
+
+// joins the worker, which may need the GIL to finish a period first
+static void stopRenderAhead(PyRtAudioObject *self) {
+    PyRtRenderAhead *a = self->_ahead;
+    if (!a || !a->running) return;
+    __atomic_store_n(&a->quit, 1, __ATOMIC_RELEASE);
+    sem_post(&self->_outputSem);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(a->worker, NULL);
+    Py_END_ALLOW_THREADS
+    a->running = 0;
+}
+
+// only after the worker stopped and the stream objects were released
+static void releaseRenderAhead(PyRtAudioObject *self) {
+    aheadDestroy(self->_ahead);
+    self->_ahead = NULL;
+}
+
+// the output ring has to exist already, the worker starts filling it at once
+static int startRenderAhead(PyRtAudioObject *self, unsigned int target,
+        unsigned int frames, unsigned int rate) {
+    PyRtRenderAhead *a = aheadCreate(self->_expectedOutputBufferLength, target, frames, rate);
+    if (!a) {
+        PyErr_NoMemory();
+        return 2;
+    }
+    self->_ahead = a;
+
+    if (pthread_create(&a->worker, NULL, renderAheadWorker, self)) {
+        releaseRenderAhead(self);
+        PyErr_SetString(PyExc_RuntimeError, "Could not start the render-ahead worker thread");
+        return 2;
+    }
+    a->running = 1;
+    return 0;
+}
+
+// this function is called by RtAudio when operating in batch mode
+static int __pyrtaudio_batchCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    PyRtBatch *b = self->_batch;
+    int last = b->index == b->periods - 1;
+    int retcode = 0;
+
+    if (b->index == 0) {
+        b->streamTime = streamTime;
+        b->status = 0;
+    }
+    b->status |= status;
+
+    // a render-only block is made when the device starts playing it
+    if (!inputBuffer && b->index == 0 && !b->stopAfter) {
+        retcode = self->_pythonCallback(b->out, NULL, frames * b->periods, streamTime, b->status, self);
+        if (retcode == 1) b->stopAfter = b->periods;
+    }
+    if (outputBuffer)
+        batchCopy(b, b->out, (char *) outputBuffer, b->outLen, b->outChannels, 0);
+    if (inputBuffer) {
+        batchCopy(b, b->in, (char *) inputBuffer, b->inLen, b->inChannels, 1);
+        // a complete input block is handed over, its output plays in the next block
+        if (last && !b->stopAfter) {
+            retcode = self->_pythonCallback(outputBuffer ? b->out : NULL, b->in,
+                    frames * b->periods, b->streamTime, b->status, self);
+            if (retcode == 1) b->stopAfter = outputBuffer ? b->periods + 1 : 1;
+        }
+    }
+    b->index = last ? 0 : b->index + 1;
+
+    if (retcode == 2) return 2;
+    // a stop takes effect once the samples rendered before it have played
+    if (b->stopAfter && --b->stopAfter == 0) return 1;
+    return 0;
+}
+
+// this function is called by RtAudio while autotune measures a trial
+static int __pyrtaudio_tuneCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    return tuneCall(self->_tune, outputBuffer, inputBuffer, frames, streamTime, status);
+}
+
+// only after the stream objects were released
+static void releaseBatch(PyRtAudioObject *self) {
+    batchDestroy(self->_batch);
+    self->_batch = NULL;
+}
+
+// the python side of the stream sees blocks of this many periods
+static int allocateBatch(PyRtAudioObject *self, unsigned int periods, unsigned int frames,
+        int output, int input) {
+    self->_batch = batchCreate(periods, frames, input ? self->_expectedInputBufferLength : 0,
+            output ? self->_expectedOutputBufferLength : 0, self->_inputChannels,
+            self->_outputChannels, self->_planar);
+    if (!self->_batch) {
+        PyErr_NoMemory();
+        return 2;
+    }
+    self->_expectedOutputBufferLength *= periods;
+    self->_expectedInputBufferLength *= periods;
+    return 0;
+}
+
+// Creates a subinterpreter and looks up the callback given as
+// 'module:function' in it. The module is searched for on the main
+// interpreter's sys.path. Errors are raised in the main interpreter.
+static int startSubinterpreter(PyRtAudioObject *self, char const *spec) {
+    char const *colon = strchr(spec, ':');
+    if (!colon || colon == spec || !colon[1]) {
+        PyErr_SetString(PyExc_ValueError, "subinterpreter must be given as 'module:function'");
+        return 2;
+    }
+
+    PyObject *path = PySys_GetObject((char *) "path");
+    if (path) path = PySequence_List(path);
+    if (!path) return 2;
+
+    PyThreadState *main = PyThreadState_Get();
+    PyThreadState *sub = Py_NewInterpreter();
+    if (!sub) {
+        PyThreadState_Swap(main);
+        Py_DECREF(path);
+        PyErr_SetString(PyExc_RuntimeError, "Could not create a subinterpreter");
+        return 2;
+    }
+
+    PyObject *function = NULL;
+    PyObject *module = NULL;
+    PyObject *name = PyString_FromStringAndSize(spec, colon - spec);
+    if (name && !PySys_SetObject((char *) "path", path))
+        module = PyImport_Import(name);
+    if (module)
+        function = PyObject_GetAttrString(module, colon + 1);
+    if (function && !PyCallable_Check(function)) {
+        PyErr_Format(PyExc_TypeError, "%s is not callable", spec);
+        Py_CLEAR(function);
+    }
+    Py_XDECREF(module);
+    Py_XDECREF(name);
+    Py_DECREF(path);
+
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    if (!function) Py_EndInterpreter(sub);
+    PyThreadState_Swap(main);
+    if (!function) {
+        PyErr_Restore(type, value, traceback);
+        return 2;
+    }
+
+    Py_XDECREF(self->_cb);
+    self->_cb = function;
+    self->_interpreter = sub;
+    return 0;
+}
+
+// Only after the callback thread dropped its thread state, which a
+// subinterpreter must not outlive. If it could not be retired the
+// interpreter is left alone instead.
+static void endSubinterpreter(PyRtAudioObject *self) {
+    PyThreadState *sub = self->_interpreter;
+    if (!sub) return;
+    Py_CLEAR(self->_cb);
+    if (self->_threadState) return;
+    self->_interpreter = NULL;
+
+    PyThreadState *main = PyThreadState_Swap(sub);
+    Py_EndInterpreter(sub);
+    PyThreadState_Swap(main);
+}
+
+// runs on the main thread once a file has played to its end
+static int runCompletion(void *arg) {
+    PyRtCompletion *c = (PyRtCompletion *) arg;
+    PyObject *result = PyObject_CallObject(c->callback, NULL);
+    if (result) Py_DECREF(result);
+    else PyErr_Print();
+    Py_DECREF(c->callback);
+    free(c);
+    return 0;
+}
+
+// this function is called by RtAudio when playing a file with play_file
+static int __pyrtaudio_fileCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    PyRtFile *f = self->_file;
+    size_t pos = f->position;
+    size_t n = f->frames - pos;
+    if (n > frames) n = frames;
+
+    fileCopy(f, (char *) outputBuffer, pos, n);
+    if (n < frames)
+        memset((char *) outputBuffer + n * self->_outputFrameBytes, 0, (frames - n) * self->_outputFrameBytes);
+    __atomic_store_n(&f->position, pos + n, __ATOMIC_RELEASE);
+    if (pos + n < f->frames)
+        return 0;
+
+    // Py_AddPendingCall needs neither the GIL nor a thread state. Should
+    // its queue be full the stream plays silence and tries again in the
+    // next period, it only stops once the completion was handed over
+    if (f->completion && !__atomic_load_n(&f->fired, __ATOMIC_ACQUIRE)) {
+        if (Py_AddPendingCall(runCompletion, f->completion))
+            return 0;
+        __atomic_store_n(&f->fired, 1, __ATOMIC_RELEASE);
+    }
+    return 1;
+}
+
+// only called while the callback is not running
+static void releaseFile(PyRtAudioObject *self) {
+    PyRtFile *f = self->_file;
+    if (!f) return;
+    self->_file = NULL;
+    // a completion handed to the main thread frees itself
+    if (f->completion && !__atomic_exchange_n(&f->fired, 1, __ATOMIC_ACQ_REL)) {
+        Py_DECREF(f->completion->callback);
+        free(f->completion);
+    }
+    fileDestroy(f);
+}
+
+// headerless files need their layout given as options
+static char const *describeRawFile(PyRtFile *f, PyObject *options) {
+    long rate = 0, channels = 0, format = 0;
+    if (getIntOption(options, "rate", &rate) || getIntOption(options, "channels", &channels) ||
+            getIntOption(options, "format", &format))
+        return "";
+    unsigned int width = widthFromFormat(format);
+    if (rate <= 0 || channels <= 0 || !width)
+        return "Not a WAV file, give rate, channels and format for raw PCM";
+
+    f->data = f->map;
+    f->rate = rate;
+    f->channels = channels;
+    f->format = format;
+    f->encoding = PYRT_FILE_COPY;
+    f->fileFrameBytes = width * channels;
+    f->frames = f->mapLen / f->fileFrameBytes;
+    return NULL;
+}
+
+// this function is called by RtAudio when recording with record_file
+static int __pyrtaudio_recordCallback(void *outputBuffer, void *inputBuffer,
+        unsigned int frames, double streamTime, RtAudioStreamStatus status,
+        void *userData) {
+    PyRtAudioObject *self = (PyRtAudioObject *) userData;
+    PyRtRecorder *r = self->_recorder;
+    size_t len = self->_expectedInputBufferLength;
+
+    // whole frames only, a partly written one would shift all that follow
+    size_t space = ringWriteAvailable(r->ring);
+    size_t n = len < space ? len : space - space % r->frameBytes;
+    ringWrite(r->ring, inputBuffer, n);
+    if (n < len)
+        __atomic_fetch_add(&r->overflows, (len - n) / r->frameBytes, __ATOMIC_RELAXED);
+    if (status & RTAUDIO_INPUT_OVERFLOW)
+        __atomic_fetch_add(&r->xruns, 1, __ATOMIC_RELAXED);
+
+    size_t queued = r->ring->size - space + n;
+    if (queued > r->highWater)
+        __atomic_store_n(&r->highWater, queued, __ATOMIC_RELAXED);
+    if (queued >= PYRT_RECORD_CHUNK && __atomic_exchange_n(&r->waiting, 0, __ATOMIC_ACQ_REL))
+        sem_post(&r->sem);
+    return 0;
+}
+
+// joins the writer once it has written out the ring and the header
+static void stopRecorder(PyRtAudioObject *self) {
+    PyRtRecorder *r = self->_recorder;
+    if (!r || !r->running) return;
+    __atomic_store_n(&r->quit, 1, __ATOMIC_RELEASE);
+    sem_post(&r->sem);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(r->writer, NULL);
+    Py_END_ALLOW_THREADS
+    r->running = 0;
+}
+
+// only after the writer stopped
+static void releaseRecorder(PyRtAudioObject *self) {
+    recorderDestroy(self->_recorder);
+    self->_recorder = NULL;
+}
+
+// start RtAudio wrap implementation
+static void
+PyRtAudio_dealloc(PyRtAudioObject *self) {
+    if (self->_rt->isStreamRunning()) {
+        retireThreadState(self);
+        self->_rt->stopStream();
+    }
+    if (self->_rt->isStreamOpen()) {
+        Py_BEGIN_ALLOW_THREADS
+        self->_rt->closeStream();
+        Py_END_ALLOW_THREADS
+    }
+        delete self->_rt;
+
+    stopDeadlineWorker(self);
+    stopRenderAhead(self);
+    releaseStreamObjects(self);
+    releaseDeadline(self);
+    releaseRenderAhead(self);
+    releaseBatch(self);
+    releaseRings(self);
+    endSubinterpreter(self);
+    releaseFile(self);
+    stopRecorder(self);
+    releaseRecorder(self);
+    traceDestroy(self->_trace);
+    PyThread_free_lock(self->_writeLock);
+    PyThread_free_lock(self->_readLock);
+    PyThread_free_lock(self->_controlLock);
+    sem_destroy(&self->_outputSem);
+    sem_destroy(&self->_inputSem);
+    sem_destroy(&self->_retireSem);
+    Py_XDECREF(self->_args);
+    Py_XDECREF(self->_streamName);
+
+    if (self->_outputView) free(self->_outputView);
+
+    Py_XDECREF(self->_cb);
+    self->_cb = NULL;
+
+    self->_outputView = NULL;
+
+    self->ob_type->tp_free((PyObject *) self);
+}
+
+static PyObject *
+PyRtAudio_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    PyRtAudioObject *self;
+
+    self = (PyRtAudioObject *) type->tp_alloc(type, 0);
+    if (self != NULL) {
+        self->_rt = new RtAudio;
+        self->_cb = NULL;
+        self->_outputView = NULL;
+        self->_zeroCopy = 0;
+        self->_inputBuffer = NULL;
+        self->_outputBuffer = NULL;
+        self->_ringDepth = 0;
+        self->_outputRing = NULL;
+        self->_inputRing = NULL;
+        self->_underflows = 0;
+        self->_overflows = 0;
+        self->_writeLock = PyThread_allocate_lock();
+        self->_readLock = PyThread_allocate_lock();
+        self->_controlLock = PyThread_allocate_lock();
+        sem_init(&self->_outputSem, 0, 0);
+        sem_init(&self->_inputSem, 0, 0);
+        self->_outputWaiting = 0;
+        self->_inputWaiting = 0;
+        self->_waitNanos = 0;
+        self->_fastCallback = 0;
+        self->_threadState = NULL;
+        self->_args = NULL;
+        self->_retireThreadState = 0;
+        self->_retireWaiting = 0;
+        sem_init(&self->_retireSem, 0, 0);
+        self->_deadline = NULL;
+        self->_pythonCallback = NULL;
+        self->_ahead = NULL;
+        self->_batch = NULL;
+        self->_interpreter = NULL;
+        self->_file = NULL;
+        self->_recorder = NULL;
+        self->_bufferFrames = 0;
+        self->_numberOfBuffers = 0;
+        self->_streamFlags = 0;
+        self->_priority = 0;
+        self->_streamName = NULL;
+        self->_tune = NULL;
+        gilStatsReset(&self->_gil);
+        self->_trace = NULL;
+    }
+    
+    return (PyObject *) self;
+}
+
+static int
+PyRtAudio_init(PyRtAudioObject *self, PyObject *args, PyObject *kwds) {
+    //nothing here right now
+    return 0;
+}
+
+// Device queries run under the control lock and with the GIL released,
+// a probe may take as long as the probe timeout.
+static PyObject *
+getDeviceCount(PyRtAudioObject *self, PyObject *args) {
+    unsigned int cnt;
+    Py_BEGIN_ALLOW_THREADS
+    cnt = self->_rt->getDeviceCount();
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("I", cnt);
+}
+
+// Builds the dict get_device_info and get_all_device_info return.
+static PyObject *
+deviceInfoToDict(RtAudio::DeviceInfo const &info) {
+    PyObject *rates = PyList_New(info.sampleRates.size());
+    if (!rates) return NULL;
+    for (size_t i = 0; i < info.sampleRates.size(); i++) {
+        PyObject *rate = PyInt_FromLong(info.sampleRates[i]);
+        if (!rate) {
+            Py_DECREF(rates);
+            return NULL;
+        }
+        PyList_SET_ITEM(rates, i, rate);
+    }
+
+    return Py_BuildValue("{s:O,s:s,s:I,s:I,s:I,s:O,s:O,s:N,s:k}",
+            "probed", ((info.probed) ? (Py_True) : (Py_False)),
+            "name", info.name.c_str(),
+            "output_channels", info.outputChannels,
+            "input_channels", info.inputChannels,
+            "duplex_channels", info.duplexChannels,
+            "default_output", ((info.isDefaultOutput) ? (Py_True) : (Py_False)),
+            "default_input", ((info.isDefaultInput) ? (Py_True) : (Py_False)),
+            "sample_rates", rates,
+            "native_formats", (unsigned long) info.nativeFormats);
+}
+
+static PyObject *
+getDeviceInfo(PyRtAudioObject *self, PyObject *args) {
+    unsigned int device;
+    if (PyArg_ParseTuple(args, "I", &device) == 0)
+        return NULL;
+
+    RtAudio::DeviceInfo temp;
+    std::string error;
+    int failed = 0;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        temp = self->_rt->getDeviceInfo(device);
+    } catch (RtError &e) {
+        error = e.getMessage();
+        failed = 1;
+    }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return deviceInfoToDict(temp);
+}
+
+// Probing reopens every device. The control lock keeps a stream from
+// being opened, which saves the device list as well, until it is done.
+static PyObject *
+getAllDeviceInfo(PyRtAudioObject *self, PyObject *args) {
+    std::vector<RtAudio::DeviceInfo> devices;
+    std::string error;
+    int failed = 0;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        devices = self->_rt->getAllDeviceInfo();
+    } catch (RtError &e) {
+        error = e.getMessage();
+        failed = 1;
+    }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *list = PyList_New(devices.size());
+    if (!list) return NULL;
+    for (size_t i = 0; i < devices.size(); i++) {
+        PyObject *info = deviceInfoToDict(devices[i]);
+        if (!info) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, info);
+    }
+    return list;
+}
+
+static PyObject *
+invalidateDeviceInfo(PyRtAudioObject *self, PyObject *args) {
+    self->_rt->invalidateDeviceInfo();
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+setProbeTimeout(PyRtAudioObject *self, PyObject *args) {
+    double seconds;
+    if (!PyArg_ParseTuple(args, "d", &seconds))
+        return NULL;
+    self->_rt->setProbeTimeout(seconds);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+PyRtAudio_getDefaultOutputDevice(PyRtAudioObject *self) {
+    unsigned int dev = self->_rt->getDefaultOutputDevice();
+    return Py_BuildValue("I", dev);
+}
+
+static PyObject *
+PyRtAudio_getDefaultInputDevice(PyRtAudioObject *self) {
+    unsigned int dev = self->_rt->getDefaultInputDevice();
+    return Py_BuildValue("I", dev);
+}
+
+static PyObject *
+PyRtAudio_isStreamOpen(PyRtAudioObject *self) {
+    bool isIt = self->_rt->isStreamOpen();
+    if (isIt) return Py_BuildValue("O", Py_True);
+    return Py_BuildValue("O", Py_False);
+}
+
+static PyObject *
+PyRtAudio_isStreamRunning(PyRtAudioObject *self) {
+    bool isIt = self->_rt->isStreamRunning();
+    if (isIt) return Py_BuildValue("O", Py_True);
+    return Py_BuildValue("O", Py_False);
+}
+
+static PyObject *
+PyRtAudio_getStreamTime(PyRtAudioObject *self) {
+    double st = self->_rt->getStreamTime();
+    return Py_BuildValue("d", st);
+}
+
+static PyObject *
+PyRtAudio_getStreamLatency(PyRtAudioObject *self) {
+    long l = self->_rt->getStreamLatency();
+    // frames python works ahead of or behind the device in batch mode
+    if (self->_batch)
+        l += batchLatency(self->_batch);
+    return Py_BuildValue("l", l);
+}
+
+static PyObject *
+PyRtAudio_getStreamOptions(PyRtAudioObject *self) {
+    if (!self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+        return NULL;
+    }
+    return Py_BuildValue("{s:I,s:I,s:l,s:l,s:O}",
+            "buffer_frames", self->_bufferFrames,
+            "number_of_buffers", self->_numberOfBuffers,
+            "flags", self->_streamFlags,
+            "priority", self->_priority,
+            "stream_name", self->_streamName ? self->_streamName : Py_None);
+}
+
+// The counters of the open stream. Times are in nanoseconds; the load is
+// the share of a period spent in the callback and sample conversions.
+static PyObject *
+PyRtAudio_getStats(PyRtAudioObject *self) {
+    RtAudio::StreamStats *stats = new RtAudio::StreamStats;
+    unsigned int rate;
+    try {
+        self->_rt->getStreamStats(*stats);
+        rate = self->_rt->getStreamSampleRate();
+    } catch (RtError &e) {
+        delete stats;
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
+    PyObject *histogram = PyList_New(0);
+    for (unsigned int i = 0; histogram && i < RtAudio::STATS_BUCKETS; i++) {
+        if (!stats->histogram[i]) continue;
+        PyObject *bucket = Py_BuildValue("(KK)", RtAudio::statsBucketNanos(i), stats->histogram[i]);
+        if (!bucket || PyList_Append(histogram, bucket)) Py_CLEAR(histogram);
+        Py_XDECREF(bucket);
+    }
+    if (!histogram) {
+        delete stats;
+        return NULL;
+    }
+
+    double period = self->_bufferFrames * 1e9 / rate;
+    double load = 0, loadMax = 0;
+    if (stats->periods && period > 0) {
+        load = (stats->callbackNanos + stats->convertNanos) / (stats->periods * period);
+        loadMax = stats->busyMax / period;
+    }
+    PyObject *result = Py_BuildValue(
+            "{s:K,s:K,s:K,s:K,s:K,s:{s:K,s:K,s:K,s:K},s:N,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:d,s:d}",
+            "periods", stats->periods,
+            "underflows", stats->underflows,
+            "overflows", stats->overflows,
+            "callback_ns", stats->callbackNanos,
+            "callback_max_ns", stats->callbackMax,
+            "callback_percentiles_ns",
+                "p50", statsPercentile(*stats, 0.5),
+                "p90", statsPercentile(*stats, 0.9),
+                "p99", statsPercentile(*stats, 0.99),
+                "p999", statsPercentile(*stats, 0.999),
+            "callback_histogram", histogram,
+            "convert_ns", stats->convertNanos,
+            "convert_max_ns", stats->convertMax,
+            "device_ns", stats->deviceNanos,
+            "device_max_ns", stats->deviceMax,
+            "gil_waits", __atomic_load_n(&self->_gil.waits, __ATOMIC_RELAXED),
+            "gil_wait_ns", __atomic_load_n(&self->_gil.nanos, __ATOMIC_RELAXED),
+            "gil_wait_max_ns", __atomic_load_n(&self->_gil.max, __ATOMIC_RELAXED),
+            "load", load,
+            "load_max", loadMax);
+    delete stats;
+    return result;
+}
+
+static PyObject *
+PyRtAudio_resetStats(PyRtAudioObject *self) {
+    try {
+        self->_rt->resetStreamStats();
+    } catch (RtError &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    gilStatsReset(&self->_gil);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// The stream buffers RtAudio holds, and the period buffers the ring,
+// deadline, render-ahead and batch modes keep on top of them.
+static PyObject *
+PyRtAudio_getStreamMemory(PyRtAudioObject *self) {
+    RtAudio::StreamMemory memory;
+    try {
+        self->_rt->getStreamMemory(memory);
+    } catch (RtError &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
+    unsigned long binding = 0;
+    if (self->_outputRing) binding += self->_outputRing->size;
+    if (self->_inputRing) binding += self->_inputRing->size;
+    if (self->_deadline)
+        binding += self->_deadline->inLen + 2 * self->_deadline->outLen;
+    if (self->_ahead) binding += self->_expectedOutputBufferLength;
+    if (self->_batch)
+        binding += self->_batch->periods * (self->_batch->inLen + self->_batch->outLen);
+
+    return Py_BuildValue("{s:(kk),s:k,s:k,s:O,s:O,s:k}",
+            "user_bytes", memory.userBytes[0], memory.userBytes[1],
+            "device_bytes", memory.deviceBytes,
+            "arena_bytes", memory.arenaBytes,
+            "locked", memory.locked ? Py_True : Py_False,
+            "huge_pages", memory.hugePages ? Py_True : Py_False,
+            "binding_bytes", binding);
+}
+
+// Starts recording the timeline of the stream threads into rings of the
+// given number of events per thread. Rings can only be resized while no
+// stream is open, something may be recording into them otherwise.
+static PyObject *
+startTrace(PyRtAudioObject *self, PyObject *args) {
+    long events = PYRT_TRACE_DEFAULT_EVENTS;
+    if (!PyArg_ParseTuple(args, "|l", &events))
+        return NULL;
+    if (events < 1 || events > (1L << 24)) {
+        PyErr_SetString(PyExc_ValueError, "The trace must hold between 1 and 2**24 events per thread");
+        return NULL;
+    }
+
+    if (!self->_trace) {
+        self->_trace = traceCreate();
+        if (!self->_trace) return PyErr_NoMemory();
+        self->_rt->setTraceHook(traceHook, self->_trace);
+    }
+    PyRtTrace *t = self->_trace;
+    if (t->capacity && self->_rt->isStreamOpen()) {
+        size_t capacity = 1;
+        while (capacity < (size_t) events) capacity <<= 1;
+        if (capacity != t->capacity) {
+            PyErr_SetString(PyExc_RuntimeError, "The trace can only be resized while no stream is open");
+            return NULL;
+        }
+    }
+    __atomic_store_n(&t->enabled, 0, __ATOMIC_RELEASE);
+    if (traceAllocate(t, events))
+        return PyErr_NoMemory();
+
+    t->since = statsNanos();
+    __atomic_store_n(&t->enabled, 1, __ATOMIC_RELEASE);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// keeps what was recorded for dump_trace
+static PyObject *
+stopTrace(PyRtAudioObject *self, PyObject *args) {
+    if (self->_trace)
+        __atomic_store_n(&self->_trace->enabled, 0, __ATOMIC_RELEASE);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// The recorded events as Chrome trace event JSON, which Perfetto reads as
+// well. Timestamps are CLOCK_MONOTONIC microseconds, see trace_clock.
+static PyObject *
+dumpTrace(PyRtAudioObject *self, PyObject *args) {
+    char const *path = NULL;
+    if (!PyArg_ParseTuple(args, "|z", &path))
+        return NULL;
+
+    std::string json("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    PyRtTrace *t = self->_trace;
+    PyRtTraceEvent *events = t && t->capacity ?
+        (PyRtTraceEvent *) malloc(t->capacity * sizeof(PyRtTraceEvent)) : NULL;
+    if (t && t->capacity && !events)
+        return PyErr_NoMemory();
+
+    char line[256];
+    char const *sep = "\n";
+    int pid = (int) getpid();
+    std::vector<pid_t> threads;
+    for (int r = 0; events && r < PYRT_TRACE_THREADS; r++) {
+        size_t n = traceCopy(t, &t->rings[r], events);
+        for (size_t i = 0; i < n; i++) {
+            PyRtTraceEvent *e = &events[i];
+            if (std::find(threads.begin(), threads.end(), e->tid) == threads.end()) {
+                threads.push_back(e->tid);
+                snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                        "\"tid\":%d,\"args\":{\"name\":\"pyrtaudio\"}}", sep, pid, (int) e->tid);
+                json += line;
+                sep = ",\n";
+            }
+            char const *ph = e->phase == RTAUDIO_TRACE_BEGIN ? "B" :
+                e->phase == RTAUDIO_TRACE_END ? "E" : "i\",\"s\":\"t";
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\","
+                    "\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d}",
+                    traceEventName(e->event), e->event < PYRT_TRACE_GIL_WAIT ? "rtaudio" : "python",
+                    ph, e->nanos / 1000, e->nanos % 1000, pid, (int) e->tid);
+            json += line;
+        }
+    }
+    free(events);
+    json += "\n]}\n";
+
+    if (!path)
+        return PyString_FromStringAndSize(json.data(), json.size());
+
+    FILE *f = fopen(path, "w");
+    if (!f || fwrite(json.data(), 1, json.size(), f) != json.size()) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+        if (f) fclose(f);
+        return NULL;
+    }
+    if (fclose(f))
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+PyRtAudio_traceClock(PyRtAudioObject *self) {
+    return PyFloat_FromDouble(statsNanos() / 1000.0);
+}
+
+static PyObject *
+PyRtAudio_getStreamSampleRate(PyRtAudioObject *self) {
+    unsigned int sr = self->_rt->getStreamSampleRate();
+    return Py_BuildValue("I", sr);
+}
+
+// 'deadline' is True for the default share of 0.75 or a share of the period
+static int getDeadlineOptions(PyObject *options, double *share, int *concealment, int *playLate) {
+    PyObject *o = options && PyDict_Check(options) ? PyDict_GetItemString(options, "deadline") : NULL;
+    if (!o || o == Py_None || o == Py_False)
+        return 0;
+
+    *share = o == Py_True ? 0.75 : PyFloat_AsDouble(o);
+    if (*share == -1 && PyErr_Occurred())
+        return 2;
+    if (*share <= 0 || *share > 1) {
+        PyErr_SetString(PyExc_ValueError, "deadline must be a share of the period between 0 and 1");
+        return 2;
+    }
+
+    char const *name = NULL;
+    if (getStringOption(options, "concealment", &name)) return 2;
+    if (name) {
+        if (!strcmp(name, "silence")) *concealment = PYRT_CONCEAL_SILENCE;
+        else if (!strcmp(name, "repeat")) *concealment = PYRT_CONCEAL_REPEAT;
+        else if (!strcmp(name, "fade")) *concealment = PYRT_CONCEAL_FADE;
+        else {
+            PyErr_SetString(PyExc_ValueError, "concealment must be 'silence', 'repeat' or 'fade'");
+            return 2;
+        }
+    }
+
+    name = NULL;
+    if (getStringOption(options, "late_results", &name)) return 2;
+    if (name) {
+        if (!strcmp(name, "play")) *playLate = 1;
+        else if (strcmp(name, "drop")) {
+            PyErr_SetString(PyExc_ValueError, "late_results must be 'drop' or 'play'");
+            return 2;
+        }
+    }
+    return 0;
+}
+
+// keeps what the device settled on for get_stream_options
+static void saveStreamOptions(PyRtAudioObject *self, unsigned int frames,
+        RtAudio::StreamOptions const &options) {
+    self->_bufferFrames = frames;
+    self->_numberOfBuffers = options.numberOfBuffers;
+    self->_streamFlags = options.flags;
+    self->_priority = options.priority;
+    Py_XDECREF(self->_streamName);
+    self->_streamName = PyString_FromString(options.streamName.c_str());
+    if (!self->_streamName) PyErr_Clear();
+}
+
+static PyObject *
+openStream(PyRtAudioObject *self, PyObject *args) {
+    char const *fmt = "OOkIIO|O";
+    PyObject *oparms, *iparms, *callback;
+    PyObject *options = NULL;
+    unsigned int srate, bframes;
+    unsigned long format;
+
+    if (!PyArg_ParseTuple(args, fmt, &oparms, &iparms, &format, &srate, &bframes, &callback, &options))
+        return NULL;
+
+    if (options && options != Py_None && !PyDict_Check(options)) {
+        PyErr_SetString(PyExc_TypeError, "Stream options must be given as a dict");
+        return NULL;
+    }
+
+    // a native RtAudioCallback is handed to RtAudio as it is, the binding
+    // does not enter the interpreter around it
+    void *nativeCallback = NULL;
+    if (getNativeCallback(callback, &nativeCallback)) return NULL;
+
+    // the callback may be loaded into a subinterpreter instead of being passed
+    char const *subinterpreter = NULL;
+    if (getStringOption(options, "subinterpreter", &subinterpreter)) return NULL;
+    if (subinterpreter && callback != Py_None) {
+        PyErr_SetString(PyExc_ValueError, "The callback must be None when it is loaded into a subinterpreter");
+        return NULL;
+    }
+
+    // without a callback the stream is driven by read and write
+    long ringDepth = callback == Py_None && !subinterpreter ? 4 : 0;
+    if (getIntOption(options, "ring_depth", &ringDepth)) return NULL;
+    if (ringDepth < 0 || ringDepth > PYRT_RING_MAX_DEPTH) {
+        PyErr_Format(PyExc_ValueError, "ring_depth must be between 0 and %d", PYRT_RING_MAX_DEPTH);
+        return NULL;
+    }
+
+    // ring mode streams are fed from python threads and need no callback
+    if (!nativeCallback && !subinterpreter && !PyCallable_Check(callback) &&
+            !(ringDepth && callback == Py_None)) {
+        PyErr_SetString(PyExc_TypeError, "Callback parameter must be callable");
+        return NULL;
+    }
+
+    // deadline mode: the share of a period the python callback may take
+    double deadline = 0;
+    int concealment = PYRT_CONCEAL_FADE;
+    int playLate = 0;
+    if (getDeadlineOptions(options, &deadline, &concealment, &playLate)) return NULL;
+    if (deadline && (ringDepth || !PyDict_CheckExact(oparms))) {
+        PyErr_SetString(PyExc_ValueError, "Deadline mode needs an output stream with a callback");
+        return NULL;
+    }
+
+    // render-ahead mode: the number of periods the callback runs ahead, the
+    // ring depth is the most it can be raised to
+    long renderAhead = 0;
+    if (getIntOption(options, "render_ahead", &renderAhead)) return NULL;
+    if (renderAhead < 0 || renderAhead > PYRT_RING_MAX_DEPTH) {
+        PyErr_Format(PyExc_ValueError, "render_ahead must be between 0 and %d", PYRT_RING_MAX_DEPTH);
+        return NULL;
+    }
+    if (renderAhead && (deadline || !(subinterpreter || PyCallable_Check(callback)) ||
+                !PyDict_CheckExact(oparms) || PyDict_CheckExact(iparms))) {
+        PyErr_SetString(PyExc_ValueError, "Render-ahead mode needs an output-only stream with a callback");
+        return NULL;
+    }
+    if (subinterpreter && ringDepth && !renderAhead) {
+        PyErr_SetString(PyExc_ValueError, "Ring mode streams have no callback to load into a subinterpreter");
+        return NULL;
+    }
+    if (renderAhead && !ringDepth)
+        ringDepth = renderAhead < 4 ? 8 : 2 * renderAhead;
+    if (ringDepth > PYRT_RING_MAX_DEPTH) ringDepth = PYRT_RING_MAX_DEPTH;
+    if (renderAhead > ringDepth) {
+        PyErr_SetString(PyExc_ValueError, "render_ahead must not exceed ring_depth");
+        return NULL;
+    }
+
+    // batch mode: the number of periods the callback gets at once
+    long batch = 0;
+    if (getIntOption(options, "batch", &batch)) return NULL;
+    if (batch < 0) {
+        PyErr_SetString(PyExc_ValueError, "batch must not be negative");
+        return NULL;
+    }
+    if (batch == 1) batch = 0;
+    if (batch && (ringDepth || deadline || renderAhead || nativeCallback)) {
+        PyErr_SetString(PyExc_ValueError, "Batch mode cannot run in ring, deadline or render-ahead mode or with a native callback");
+        return NULL;
+    }
+
+    void *userData = self;
+    if (nativeCallback) {
+        if (ringDepth || deadline || renderAhead) {
+            PyErr_SetString(PyExc_ValueError, "Native callbacks cannot run in ring, deadline or render-ahead mode");
+            return NULL;
+        }
+        userData = NULL;
+        if (getPointerOption(options, "user_data", &userData)) return NULL;
+    }
+
+    if (self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "A stream is already open");
+        return NULL;
+    }
+
+    Py_XINCREF(callback);
+    Py_XDECREF(self->_cb);
+    self->_cb = callback;
+
+    int hasOutputParams = PyDict_CheckExact(oparms);
+    int hasInputParams = PyDict_CheckExact(iparms);
+    if (!hasOutputParams && !hasInputParams) {
+        PyErr_SetString(PyExc_TypeError, "No input or output parameters given");
+        return NULL;
+    }
+
+    RtAudio::StreamParameters *inputParams = NULL;
+    RtAudio::StreamParameters *outputParams = NULL;
+
+    if (self->_outputView) free(self->_outputView);
+    self->_outputView = NULL;
+    releaseStreamObjects(self);
+    releaseRings(self);
+    releaseBatch(self);
+    self->_ringDepth = (unsigned int) ringDepth;
+    // in-place mode wraps the input as well
+    int inPlace = getFlagOption(options, "in_place");
+    self->_zeroCopy = inPlace || getFlagOption(options, "zero_copy");
+    self->_fastCallback = getFlagOption(options, "fast_callback");
+
+    long flags = 0, numberOfBuffers = 0, priority = 0;
+    char const *streamName = NULL;
+    if (getIntOption(options, "flags", &flags) ||
+            getIntOption(options, "number_of_buffers", &numberOfBuffers) ||
+            getIntOption(options, "priority", &priority) ||
+            getStringOption(options, "stream_name", &streamName))
+        return NULL;
+    if (numberOfBuffers < 0) {
+        PyErr_SetString(PyExc_ValueError, "number_of_buffers must not be negative");
+        return NULL;
+    }
+    RtAudio::StreamOptions streamOptions;
+    streamOptions.flags = flags;
+    streamOptions.numberOfBuffers = numberOfBuffers;
+    streamOptions.priority = priority;
+    if (streamName) streamOptions.streamName = streamName;
+    self->_planar = (flags & RTAUDIO_NONINTERLEAVED) != 0;
+    self->_format = format;
+    self->_typed = getFlagOption(options, "typed");
+
+    if (hasOutputParams) { 
+        outputParams = populateStreamParameters(oparms);
+        if (!outputParams) {
+            PyErr_SetString(PyExc_AttributeError, "Error in output parameters");
+            return NULL;
+        }
+        self->_outputView = (Py_buffer *) malloc(sizeof(*(self->_outputView)));
+        self->_outputChannels = outputParams->nChannels;
+    }
+    if (hasInputParams) {
+        inputParams = populateStreamParameters(iparms);
+        if (!inputParams) {
+            if (outputParams) delete outputParams;
+            PyErr_SetString(PyExc_AttributeError, "Error in input parameters");
+            return NULL;
+        }
+        self->_inputChannels = inputParams->nChannels;
+    }
+
+    if (subinterpreter && startSubinterpreter(self, subinterpreter)) {
+        if (outputParams) delete outputParams;
+        if (inputParams)  delete inputParams;
+        return NULL;
+    }
+
+    // decide which callback to use
+    RtAudioCallback cb = NULL;
+    if (outputParams && !inputParams) 
+        cb = inPlace ? __pyrtaudio_renderInPlaceCallback : __pyrtaudio_renderCallback;
+    else if (!outputParams && inputParams) 
+        cb = __pyrtaudio_captureCallback;
+    else if (outputParams && inputParams)
+        cb = inPlace ? __pyrtaudio_duplexInPlaceCallback : __pyrtaudio_duplexCallback;
+    if (self->_ringDepth && !renderAhead)
+        cb = __pyrtaudio_ringCallback;
+    if (deadline) {
+        self->_pythonCallback = cb;
+        cb = __pyrtaudio_deadlineCallback;
+    }
+    if (renderAhead) {
+        self->_pythonCallback = cb;
+        cb = __pyrtaudio_renderAheadCallback;
+    }
+    if (batch) {
+        self->_pythonCallback = cb;
+        cb = __pyrtaudio_batchCallback;
+    }
+    if (nativeCallback)
+        cb = (RtAudioCallback) nativeCallback;
+    if (self->_tune) {
+        self->_tune->callback = cb;
+        self->_tune->userData = userData;
+        cb = __pyrtaudio_tuneCallback;
+        userData = self;
+    }
+
+    int failed = 0;
+    try {
+        self->_rt->openStream(outputParams, inputParams, format, srate, &bframes, cb, userData,
+                &streamOptions);
+    } catch (RtError &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        failed = 1;
+    }
+
+    // the device may have chosen a different buffer size than requested,
+    // so the expected lengths are computed from the actual one
+    if (outputParams) {
+        self->_outputFrameBytes = widthFromFormat(format) * outputParams->nChannels;
+        self->_expectedOutputBufferLength = self->_outputFrameBytes;
+        self->_expectedOutputBufferLength *= bframes;
+    }
+    if (inputParams) {
+        self->_inputFrameBytes = widthFromFormat(format) * inputParams->nChannels;
+        self->_expectedInputBufferLength = self->_inputFrameBytes;
+        self->_expectedInputBufferLength *= bframes;
+    }
+
+    // the rings are sized from the actual buffer size as well
+    if (!failed && self->_ringDepth && allocateRings(self, outputParams != NULL, inputParams != NULL)) {
+        self->_rt->closeStream();
+        failed = 1;
+    }
+    if (!failed && batch && allocateBatch(self, batch, bframes, outputParams != NULL, inputParams != NULL)) {
+        self->_rt->closeStream();
+        failed = 1;
+    }
+    if (!failed && deadline && startDeadlineWorker(self,
+                inputParams ? self->_expectedInputBufferLength : 0, bframes, srate, deadline, concealment, playLate)) {
+        self->_rt->closeStream();
+        failed = 1;
+    }
+    // blocked readers and writers recheck the stream at least every two periods
+    self->_waitNanos = 2000000000.0 * bframes / srate;
+    if (self->_waitNanos < 1000000) self->_waitNanos = 1000000;
+    if (self->_waitNanos > 999999999) self->_waitNanos = 999999999;
+    if (!failed && renderAhead && startRenderAhead(self, renderAhead, bframes, srate)) {
+        self->_rt->closeStream();
+        releaseRings(self);
+        failed = 1;
+    }
+
+    if (outputParams) delete outputParams;
+    if (inputParams)  delete inputParams;
+
+    if (failed) {
+        endSubinterpreter(self);
+        return NULL;
+    }
+
+    saveStreamOptions(self, bframes, streamOptions);
+    gilStatsReset(&self->_gil);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+startStream(PyRtAudioObject *self, PyObject *args) {
+    if (!self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+        return NULL; //openStream was not called
+    }
+    if (self->_rt->isStreamRunning()) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream already running");
+        return NULL; //stream is already running
+    }
+
+    __atomic_store_n(&self->_retireThreadState, 0, __ATOMIC_RELEASE);
+    // a stop or abort the callback asked for is over with the restart
+    if (self->_ahead) {
+        __atomic_store_n(&self->_ahead->retcode, 0, __ATOMIC_RELEASE);
+        wakeRingWaiters(self);
+    }
+    // the callback is not running, so the batch can be reset in place
+    if (self->_batch) {
+        self->_batch->index = 0;
+        self->_batch->stopAfter = 0;
+    }
+    self->_rt->startStream();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+stopStream(PyRtAudioObject *self, PyObject *args) {
+    if (!self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+        return NULL;
+    }
+    if (!self->_rt->isStreamRunning()) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream is not running");
+        return NULL;
+    }
+
+    retireThreadState(self);
+    // the callback may be waiting for the GIL, and some APIs wait for it
+    Py_BEGIN_ALLOW_THREADS
+    self->_rt->stopStream();
+    Py_END_ALLOW_THREADS
+    wakeRingWaiters(self);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+abortStream(PyRtAudioObject *self, PyObject *args) {
+    if (!self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+        return NULL;
+    }
+    if (!self->_rt->isStreamRunning()) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream is not running");
+        return NULL;
+    }
+
+    retireThreadState(self);
+    // the callback may be waiting for the GIL, and some APIs wait for it
+    Py_BEGIN_ALLOW_THREADS
+    self->_rt->abortStream();
+    Py_END_ALLOW_THREADS
+    wakeRingWaiters(self);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+closeStream(PyRtAudioObject *self, PyObject *args) {
+    if (!self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+        return NULL;
+    }
+
+    retireThreadState(self);
+    // joins the callback thread, which may be waiting for the GIL
+    Py_BEGIN_ALLOW_THREADS
+    self->_rt->closeStream();
+    Py_END_ALLOW_THREADS
+    stopDeadlineWorker(self);
+    stopRenderAhead(self);
+    releaseStreamObjects(self);
+    releaseDeadline(self);
+    releaseRenderAhead(self);
+    releaseBatch(self);
+    endSubinterpreter(self);
+    releaseFile(self);
+    stopRecorder(self);
+    releaseRecorder(self);
+
+    // blocked readers and writers hold the direction locks until they
+    // notice the stream is gone, only then can the rings be freed
+    wakeRingWaiters(self);
+    acquireLock(self->_writeLock);
+    acquireLock(self->_readLock);
+    releaseRings(self);
+    PyThread_release_lock(self->_readLock);
+    PyThread_release_lock(self->_writeLock);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// the trial order: lowest latency last, the larger period first among equals
+static bool tuneOrder(std::pair<long, long> const &a, std::pair<long, long> const &b) {
+    return a.first * a.second > b.first * b.second;
+}
+
+// Runs the callback for a while with the given period size and buffer
+// count and appends what was measured to trials. Returns 1 if the trial
+// saw no xruns and the callback always took at most headroom of a
+// period, 0 if not and -1 on a python error. A configuration the device
+// refuses counts as unstable.
+static int tuneTrial(PyRtAudioObject *self, PyObject *oparms, PyObject *iparms,
+        unsigned long format, unsigned int srate, PyObject *callback, PyObject *options,
+        std::pair<long, long> const &candidate, double seconds, double headroom, PyObject *trials) {
+    PyObject *buffers = PyInt_FromLong(candidate.second);
+    if (!buffers || PyDict_SetItemString(options, "number_of_buffers", buffers)) {
+        Py_XDECREF(buffers);
+        return -1;
+    }
+    Py_DECREF(buffers);
+    PyObject *args = Py_BuildValue("(OOkIlOO)", oparms, iparms, format, srate, candidate.first,
+            callback, options);
+    if (!args) return -1;
+
+    PyRtTune tune;
+    tuneReset(&tune);
+    self->_tune = &tune;
+    PyObject *result = openStream(self, args);
+    Py_DECREF(args);
+    if (!result) {
+        self->_tune = NULL;
+        if (!PyErr_ExceptionMatches(PyExc_RuntimeError)) return -1;
+        PyErr_Clear();
+        result = Py_BuildValue("{s:l,s:l,s:O}", "buffer_frames", candidate.first,
+                "number_of_buffers", candidate.second, "stable", Py_False);
+        if (!result || PyList_Append(trials, result)) {
+            Py_XDECREF(result);
+            return -1;
+        }
+        Py_DECREF(result);
+        return 0;
+    }
+    Py_DECREF(result);
+
+    result = startStream(self, NULL);
+    if (result) {
+        Py_DECREF(result);
+        // a callback that stops the stream ends the trial early
+        struct timespec step = {0, 10000000};
+        Py_BEGIN_ALLOW_THREADS
+        for (double waited = 0; waited < seconds && self->_rt->isStreamRunning(); waited += 0.01)
+            nanosleep(&step, NULL);
+        Py_END_ALLOW_THREADS
+        if (self->_rt->isStreamRunning())
+            result = stopStream(self, NULL);
+        Py_XDECREF(result);
+    }
+    PyObject *closed = closeStream(self, NULL);
+    self->_tune = NULL;
+    if (!result || !closed) {
+        Py_XDECREF(closed);
+        return -1;
+    }
+    Py_DECREF(closed);
+
+    double period = (double) self->_bufferFrames / srate;
+    unsigned long periods = __atomic_load_n(&tune.periods, __ATOMIC_ACQUIRE);
+    int stable = periods > PYRT_TUNE_WARMUP && !tune.xruns && tune.nanosMax <= headroom * period * 1e9;
+    result = Py_BuildValue("{s:I,s:I,s:k,s:k,s:d,s:O}",
+            "buffer_frames", self->_bufferFrames,
+            "number_of_buffers", self->_numberOfBuffers,
+            "periods", periods,
+            "xruns", tune.xruns,
+            "callback_max", tune.nanosMax / 1e9,
+            "stable", stable ? Py_True : Py_False);
+    if (!result || PyList_Append(trials, result)) {
+        Py_XDECREF(result);
+        return -1;
+    }
+    Py_DECREF(result);
+    return stable;
+}
+
+// Looks for the lowest latency the callback keeps up with under the
+// current load. Trial streams step from the most conservative period size
+// and buffer count down for as long as they are stable. Once one is not,
+// the last stable configuration is tried again, and the search steps back
+// up should the load have grown meanwhile. The stream is left open in the
+// configuration found, not started.
+static PyObject *
+autotune(PyRtAudioObject *self, PyObject *args) {
+    PyObject *oparms, *iparms, *callback;
+    PyObject *options = NULL, *tuning = NULL;
+    unsigned int srate;
+    unsigned long format;
+    if (!PyArg_ParseTuple(args, "OOkIO|OO", &oparms, &iparms, &format, &srate, &callback,
+                &options, &tuning))
+        return NULL;
+
+    if ((options && options != Py_None && !PyDict_Check(options)) ||
+            (tuning && tuning != Py_None && !PyDict_Check(tuning))) {
+        PyErr_SetString(PyExc_TypeError, "Stream and tuning options must be given as dicts");
+        return NULL;
+    }
+    long maxFrames = 1024, minFrames = 32, maxBuffers = 4, minBuffers = 2;
+    double seconds = 1.0, headroom = 0.75;
+    if (getIntOption(tuning, "max_frames", &maxFrames) ||
+            getIntOption(tuning, "min_frames", &minFrames) ||
+            getIntOption(tuning, "max_buffers", &maxBuffers) ||
+            getIntOption(tuning, "min_buffers", &minBuffers) ||
+            getDoubleOption(tuning, "trial_seconds", &seconds) ||
+            getDoubleOption(tuning, "headroom", &headroom))
+        return NULL;
+    if (minFrames < 1 || maxFrames < minFrames || minBuffers < 2 || maxBuffers < minBuffers) {
+        PyErr_SetString(PyExc_ValueError, "The frame and buffer ranges must be positive, with at least 2 buffers");
+        return NULL;
+    }
+    if (seconds <= 0 || headroom <= 0 || headroom > 1) {
+        PyErr_SetString(PyExc_ValueError, "trial_seconds must be positive and headroom between 0 and 1");
+        return NULL;
+    }
+    if (self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "A stream is already open");
+        return NULL;
+    }
+
+    // the period size halves from step to step
+    std::vector< std::pair<long, long> > candidates;
+    for (long frames = maxFrames; frames >= minFrames; frames /= 2)
+        for (long buffers = maxBuffers; buffers >= minBuffers; buffers--)
+            candidates.push_back(std::make_pair(frames, buffers));
+    std::stable_sort(candidates.begin(), candidates.end(), tuneOrder);
+
+    PyObject *streamOptions = options && options != Py_None ? PyDict_Copy(options) : PyDict_New();
+    PyObject *trials = PyList_New(0);
+    PyObject *result = NULL;
+    int good = -1, stable = 1;
+    if (!streamOptions || !trials) goto done;
+
+    for (size_t i = 0; i < candidates.size() && stable; i++) {
+        stable = tuneTrial(self, oparms, iparms, format, srate, callback, streamOptions,
+                candidates[i], seconds, headroom, trials);
+        if (stable < 0) goto done;
+        if (stable) good = i;
+    }
+    // a failed step down may have been the load changing, not the step
+    while (!stable && good >= 0) {
+        stable = tuneTrial(self, oparms, iparms, format, srate, callback, streamOptions,
+                candidates[good], seconds, headroom, trials);
+        if (stable < 0) goto done;
+        if (!stable) good--;
+    }
+    if (good < 0) {
+        PyErr_Format(PyExc_RuntimeError, "The callback does not keep up even with %ld frames in %ld buffers",
+                candidates[0].first, candidates[0].second);
+        goto done;
+    }
+
+    {
+        PyObject *buffers = PyInt_FromLong(candidates[good].second);
+        if (!buffers || PyDict_SetItemString(streamOptions, "number_of_buffers", buffers)) {
+            Py_XDECREF(buffers);
+            goto done;
+        }
+        Py_DECREF(buffers);
+        PyObject *openArgs = Py_BuildValue("(OOkIlOO)", oparms, iparms, format, srate,
+                candidates[good].first, callback, streamOptions);
+        PyObject *opened = openArgs ? openStream(self, openArgs) : NULL;
+        Py_XDECREF(openArgs);
+        if (!opened) goto done;
+        Py_DECREF(opened);
+    }
+
+    // the device reports its latency only once the stream runs
+    result = Py_BuildValue("{s:I,s:I,s:k,s:O}",
+            "buffer_frames", self->_bufferFrames,
+            "number_of_buffers", self->_numberOfBuffers,
+            "buffered_frames", (unsigned long) self->_bufferFrames * self->_numberOfBuffers,
+            "trials", trials);
+
+done:
+    Py_XDECREF(streamOptions);
+    Py_XDECREF(trials);
+    return result;
+}
+
+// The stream control methods wait for the callback and worker threads
+// without holding the GIL, so another python thread could otherwise get in
+// between, e.g. close a stream that is still being stopped. Everything the
+// callbacks read is set up while no stream is open, or accessed atomically.
+static PyObject *
+controlStream(PyRtAudioObject *self, PyObject *args,
+        PyObject *(*method)(PyRtAudioObject *, PyObject *)) {
+    acquireLock(self->_controlLock);
+    PyObject *result = method(self, args);
+    PyThread_release_lock(self->_controlLock);
+    return result;
+}
+
+// Plays a file without python being called per period. The file is
+// mapped, not read, and the stream format and rate are the file's.
+static PyObject *
+playFile(PyRtAudioObject *self, PyObject *args) {
+    char const *path;
+    PyObject *options = NULL;
+    if (!PyArg_ParseTuple(args, "s|O", &path, &options))
+        return NULL;
+
+    if (options && options != Py_None && !PyDict_Check(options)) {
+        PyErr_SetString(PyExc_TypeError, "Playback options must be given as a dict");
+        return NULL;
+    }
+
+    // a file that played to its end makes way for the next one
+    if (self->_file && self->_rt->isStreamOpen() && !self->_rt->isStreamRunning()) {
+        PyObject *closed = closeStream(self, NULL);
+        if (!closed) return NULL;
+        Py_DECREF(closed);
+    }
+    if (self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "A stream is already open");
+        return NULL;
+    }
+
+    long device = self->_rt->getDefaultOutputDevice();
+    long firstChannel = 0;
+    long bufferFrames = 512;
+    if (getIntOption(options, "device_id", &device) ||
+            getIntOption(options, "first_channel", &firstChannel) ||
+            getIntOption(options, "buffer_frames", &bufferFrames))
+        return NULL;
+    PyObject *onComplete = options && options != Py_None ? PyDict_GetItemString(options, "on_complete") : NULL;
+    if (onComplete == Py_None) onComplete = NULL;
+    if (onComplete && !PyCallable_Check(onComplete)) {
+        PyErr_SetString(PyExc_TypeError, "on_complete must be callable");
+        return NULL;
+    }
+
+    PyRtFile *f = (PyRtFile *) calloc(1, sizeof(PyRtFile));
+    if (!f) return PyErr_NoMemory();
+    int failed;
+    Py_BEGIN_ALLOW_THREADS
+    failed = fileMap(f, path);
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        fileDestroy(f);
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+    }
 
-    retcode = getArgList(&arglist, &bytearray);
-    if (retcode) goto cleanup_no_arglist;
+    char const *error = fileIsWav(f) ? fileParseWav(f) : describeRawFile(f, options);
+    if (!error && onComplete) {
+        f->completion = (PyRtCompletion *) malloc(sizeof(PyRtCompletion));
+        if (!f->completion) {
+            error = "";
+        } else {
+            Py_INCREF(onComplete);
+            f->completion->callback = onComplete;
+        }
+    }
+    if (error) {
+        fileDestroy(f);
+        if (!PyErr_Occurred()) {
+            if (*error) PyErr_SetString(PyExc_ValueError, error);
+            else PyErr_NoMemory();
+        }
+        return NULL;
+    }
 
-    result = PyEval_CallObject(self->_cb, arglist);
+    releaseStreamObjects(self);
+    releaseRings(self);
+    self->_ringDepth = 0;
+    self->_file = f;
+    self->_format = f->format;
+    self->_outputChannels = f->channels;
+    self->_outputFrameBytes = widthFromFormat(f->format) * f->channels;
+
+    RtAudio::StreamParameters params;
+    params.deviceId = device;
+    params.nChannels = f->channels;
+    params.firstChannel = firstChannel;
+    unsigned int frames = bufferFrames;
+    RtAudio::StreamOptions streamOptions;
+    try {
+        self->_rt->openStream(&params, NULL, f->format, f->rate, &frames,
+                __pyrtaudio_fileCallback, (void *) self, &streamOptions);
+    } catch (RtError &e) {
+        releaseFile(self);
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    saveStreamOptions(self, frames, streamOptions);
+    gilStatsReset(&self->_gil);
+    self->_expectedOutputBufferLength = (unsigned long) self->_outputFrameBytes * frames;
 
-    retcode = isNone(result);
-    if (retcode) goto cleanup_none_returned;
+    if (getFlagOption(options, "start", 1))
+        return startStream(self, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-    retcode = isBuffer(result);
-    if (retcode) goto cleanup_not_a_buffer;
+// Records to a WAV file without python being called per period. The
+// file is written by a thread of its own and finished by close_stream.
+static PyObject *
+recordFile(PyRtAudioObject *self, PyObject *args) {
+    char const *path;
+    PyObject *options = NULL;
+    if (!PyArg_ParseTuple(args, "s|O", &path, &options))
+        return NULL;
 
-    retcode = getBuffer(result, &view);
-    if (retcode) goto cleanup_could_not_extract;
+    if (options && options != Py_None && !PyDict_Check(options)) {
+        PyErr_SetString(PyExc_TypeError, "Recording options must be given as a dict");
+        return NULL;
+    }
+    if (self->_rt->isStreamOpen()) {
+        PyErr_SetString(PyExc_RuntimeError, "A stream is already open");
+        return NULL;
+    }
 
-    retcode = checkLength(self->_expectedOutputBufferLength, view->len);
-    if (retcode) goto cleanup_unexpected_length;
+    long device = self->_rt->getDefaultInputDevice();
+    long firstChannel = 0, channels = 2, rate = 48000, bufferFrames = 512;
+    long format = RTAUDIO_SINT16, ringSeconds = 4, preallocateSeconds = 60;
+    if (getIntOption(options, "device_id", &device) ||
+            getIntOption(options, "first_channel", &firstChannel) ||
+            getIntOption(options, "channels", &channels) ||
+            getIntOption(options, "rate", &rate) ||
+            getIntOption(options, "format", &format) ||
+            getIntOption(options, "buffer_frames", &bufferFrames) ||
+            getIntOption(options, "ring_seconds", &ringSeconds) ||
+            getIntOption(options, "preallocate_seconds", &preallocateSeconds))
+        return NULL;
+    if (format != RTAUDIO_SINT8 && format != RTAUDIO_SINT16 && format != RTAUDIO_SINT32 &&
+            format != RTAUDIO_FLOAT32 && format != RTAUDIO_FLOAT64) {
+        PyErr_SetString(PyExc_ValueError, "Recordings can be made in SINT8, SINT16, SINT32, FLOAT32 or FLOAT64");
+        return NULL;
+    }
+    if (channels <= 0 || rate <= 0 || ringSeconds <= 0 || preallocateSeconds < 0) {
+        PyErr_SetString(PyExc_ValueError, "channels, rate and ring_seconds must be positive");
+        return NULL;
+    }
 
-    memcpy(outputBuffer, view->buf, view->len);
+    unsigned int frameBytes = widthFromFormat(format) * channels;
+    uint64_t secondBytes = (uint64_t) frameBytes * rate;
+    // the ring holds at least a few chunks for the writer to take
+    size_t ringBytes = secondBytes * ringSeconds;
+    if (ringBytes < 4 * PYRT_RECORD_CHUNK) ringBytes = 4 * PYRT_RECORD_CHUNK;
+
+    PyRtRecorder *r;
+    Py_BEGIN_ALLOW_THREADS
+    r = recorderCreate(path, getFlagOption(options, "direct"), format, channels, rate,
+            frameBytes, ringBytes, secondBytes * preallocateSeconds);
+    Py_END_ALLOW_THREADS
+    if (!r) return PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+
+    releaseStreamObjects(self);
+    releaseRings(self);
+    self->_ringDepth = 0;
+    self->_recorder = r;
+    self->_format = format;
+    self->_inputChannels = channels;
+    self->_inputFrameBytes = frameBytes;
+
+    RtAudio::StreamParameters params;
+    params.deviceId = device;
+    params.nChannels = channels;
+    params.firstChannel = firstChannel;
+    unsigned int frames = bufferFrames;
+    RtAudio::StreamOptions streamOptions;
+    try {
+        self->_rt->openStream(NULL, &params, format, rate, &frames,
+                __pyrtaudio_recordCallback, (void *) self, &streamOptions);
+    } catch (RtError &e) {
+        releaseRecorder(self);
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    saveStreamOptions(self, frames, streamOptions);
+    gilStatsReset(&self->_gil);
+    self->_expectedInputBufferLength = (unsigned long) frameBytes * frames;
+
+    if (pthread_create(&r->writer, NULL, recordWriter, r)) {
+        self->_rt->closeStream();
+        releaseRecorder(self);
+        PyErr_SetString(PyExc_RuntimeError, "Could not start the recorder writer thread");
+        return NULL;
+    }
+    r->running = 1;
+
+    // only now does the recording replace whatever was at path
+    if (recorderCommit(r)) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+        self->_rt->closeStream();
+        stopRecorder(self);
+        releaseRecorder(self);
+        return NULL;
+    }
 
-    cleanup_unexpected_length:
-    PyBuffer_Release(view);
-    cleanup_could_not_extract:
-    cleanup_not_a_buffer:
-    cleanup_none_returned:
-    Py_DECREF(result);
-    Py_DECREF(arglist);
-    cleanup_no_arglist:
-    Py_DECREF(bytearray);
-    cleanup_no_bytearray:
-    PYGILSTATE_RELEASE;
-    return retcode;
+    if (getFlagOption(options, "start", 1))
+        return startStream(self, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
-// start RtAudio wrap implementation
-static void
-PyRtAudio_dealloc(PyRtAudioObject *self) {
-    if (self->_rt->isStreamRunning()) self->_rt->stopStream();
-    if (self->_rt->isStreamOpen()) self->_rt->closeStream();
-        delete self->_rt;
+static PyObject *
+PyRtAudio_openStream(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, openStream);
+}
 
-    if (self->_outputView) free(self->_outputView);
+static PyObject *
+PyRtAudio_recordFile(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, recordFile);
+}
 
-    Py_XDECREF(self->_cb);
-    self->_cb = NULL;
+static PyObject *
+PyRtAudio_playFile(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, playFile);
+}
 
-    self->_outputView = NULL;
+static PyObject *
+PyRtAudio_autotune(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, autotune);
+}
 
-    self->ob_type->tp_free((PyObject *) self);
+static PyObject *
+PyRtAudio_startStream(PyRtAudioObject *self) {
+    return controlStream(self, NULL, startStream);
 }
 
 static PyObject *
-PyRtAudio_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
-    PyRtAudioObject *self;
+PyRtAudio_stopStream(PyRtAudioObject *self) {
+    return controlStream(self, NULL, stopStream);
+}
 
-    self = (PyRtAudioObject *) type->tp_alloc(type, 0);
-    if (self != NULL) {
-        self->_rt = new RtAudio;
-        self->_cb = NULL;
-        self->_outputView = NULL;
-    }
-    
-    return (PyObject *) self;
+static PyObject *
+PyRtAudio_abortStream(PyRtAudioObject *self) {
+    return controlStream(self, NULL, abortStream);
 }
 
-static int
-PyRtAudio_init(PyRtAudioObject *self, PyObject *args, PyObject *kwds) {
-    //nothing here right now
-    return 0;
+static PyObject *
+PyRtAudio_closeStream(PyRtAudioObject *self) {
+    return controlStream(self, NULL, closeStream);
 }
 
 static PyObject *
 PyRtAudio_getDeviceCount(PyRtAudioObject *self) {
-    unsigned int cnt = self->_rt->getDeviceCount();
-    return Py_BuildValue("I", cnt);
+    return controlStream(self, NULL, getDeviceCount);
 }
 
 static PyObject *
 PyRtAudio_getDeviceInfo(PyRtAudioObject *self, PyObject *args) {
-    unsigned int device;
-    if (PyArg_ParseTuple(args, "I", &device) == 0)
-        return NULL;
-
-    RtAudio::DeviceInfo temp = self->_rt->getDeviceInfo(device);
-    
-    printf("%d, %s\n", temp.outputChannels, temp.name.c_str());
-    return Py_BuildValue("{s:O,s:s,s:I,s:I,s:I,s:O,s:O}", 
-            "probed", ((temp.probed) ? (Py_True) : (Py_False)),
-            "name", temp.name.c_str(),
-            "output_channels", temp.outputChannels,
-            "input_channels", temp.inputChannels,
-            "duplex_channels", temp.duplexChannels,
-            "default_output", ((temp.isDefaultOutput) ? (Py_True) : (Py_False)),
-            "default_input", ((temp.isDefaultInput) ? (Py_True) : (Py_False)));
+    return controlStream(self, args, getDeviceInfo);
 }
 
 static PyObject *
-PyRtAudio_getDefaultOutputDevice(PyRtAudioObject *self) {
-    unsigned int dev = self->_rt->getDefaultOutputDevice();
-    return Py_BuildValue("I", dev);
+PyRtAudio_getAllDeviceInfo(PyRtAudioObject *self) {
+    return controlStream(self, NULL, getAllDeviceInfo);
 }
 
 static PyObject *
-PyRtAudio_getDefaultInputDevice(PyRtAudioObject *self) {
-    unsigned int dev = self->_rt->getDefaultInputDevice();
-    return Py_BuildValue("I", dev);
+PyRtAudio_invalidateDeviceInfo(PyRtAudioObject *self) {
+    return controlStream(self, NULL, invalidateDeviceInfo);
 }
 
 static PyObject *
-PyRtAudio_isStreamOpen(PyRtAudioObject *self) {
-    bool isIt = self->_rt->isStreamOpen();
-    if (isIt) return Py_BuildValue("O", Py_True);
-    return Py_BuildValue("O", Py_False);
+PyRtAudio_setProbeTimeout(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, setProbeTimeout);
 }
 
 static PyObject *
-PyRtAudio_isStreamRunning(PyRtAudioObject *self) {
-    bool isIt = self->_rt->isStreamRunning();
-    if (isIt) return Py_BuildValue("O", Py_True);
-    return Py_BuildValue("O", Py_False);
+PyRtAudio_startTrace(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, startTrace);
 }
 
 static PyObject *
-PyRtAudio_getStreamTime(PyRtAudioObject *self) {
-    double st = self->_rt->getStreamTime();
-    return Py_BuildValue("d", st);
+PyRtAudio_stopTrace(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, stopTrace);
 }
 
 static PyObject *
-PyRtAudio_getStreamLatency(PyRtAudioObject *self) {
-    long l = self->_rt->getStreamLatency();
-    return Py_BuildValue("l", l);
+PyRtAudio_dumpTrace(PyRtAudioObject *self, PyObject *args) {
+    return controlStream(self, args, dumpTrace);
 }
 
 static PyObject *
-PyRtAudio_getStreamSampleRate(PyRtAudioObject *self) {
-    unsigned int sr = self->_rt->getStreamSampleRate();
-    return Py_BuildValue("I", sr);
+streamWrite(PyRtAudioObject *self, PyObject *args, int block) {
+    Py_buffer view;
+    if (!PyArg_ParseTuple(args, "s*", &view))
+        return NULL;
+
+    // the ring may be replaced while waiting for the lock, so check after
+    acquireLock(self->_writeLock);
+    Py_ssize_t frames = -1;
+    if (!self->_outputRing)
+        PyErr_SetString(PyExc_RuntimeError, "No output ring, open a ring mode stream with output first");
+    else if (self->_ahead)
+        PyErr_SetString(PyExc_RuntimeError, "The output ring is fed by the render-ahead worker");
+    else if (view.len % self->_outputFrameBytes)
+        PyErr_SetString(PyExc_BufferError, "Buffer length is not a whole number of frames");
+    else
+        frames = ringWriteFrames(self, (char const *) view.buf, view.len, block);
+    PyThread_release_lock(self->_writeLock);
+    PyBuffer_Release(&view);
+
+    if (frames < 0) return NULL;
+    return Py_BuildValue("n", frames);
 }
 
 static PyObject *
-PyRtAudio_openStream(PyRtAudioObject *self, PyObject *args) {
-    char const *fmt = "OOkIIO";
-    PyObject *oparms, *iparms, *callback;
-    unsigned int srate, bframes;
-    unsigned long format;
-
-    if (!PyArg_ParseTuple(args, fmt, &oparms, &iparms, &format, &srate, &bframes, &callback))
+streamRead(PyRtAudioObject *self, PyObject *args, int block) {
+    unsigned long frames;
+    if (!PyArg_ParseTuple(args, "k", &frames))
         return NULL;
 
-    if (!PyCallable_Check(callback)) {
-        PyErr_SetString(PyExc_TypeError, "Callback parameter must be callable");
+    acquireLock(self->_readLock);
+    if (!self->_inputRing) {
+        PyThread_release_lock(self->_readLock);
+        PyErr_SetString(PyExc_RuntimeError, "No input ring, open a ring mode stream with input first");
         return NULL;
     }
 
-    Py_XINCREF(callback);
-    Py_XDECREF(self->_cb);
-    self->_cb = callback;
+    PyObject *data = PyByteArray_FromStringAndSize(NULL, frames * self->_inputFrameBytes);
+    Py_ssize_t got = -1;
+    if (data)
+        got = ringReadFrames(self, PyByteArray_AS_STRING(data), frames * self->_inputFrameBytes, block);
+    PyThread_release_lock(self->_readLock);
 
-    int hasOutputParams = PyDict_CheckExact(oparms);
-    int hasInputParams = PyDict_CheckExact(iparms);
-    if (!hasOutputParams && !hasInputParams) {
-        PyErr_SetString(PyExc_TypeError, "No input or output parameters given");
+    if (got < 0 || PyByteArray_Resize(data, got * self->_inputFrameBytes)) {
+        Py_XDECREF(data);
         return NULL;
     }
+    return data;
+}
 
-    RtAudio::StreamParameters *inputParams = NULL;
-    RtAudio::StreamParameters *outputParams = NULL;
+static PyObject *
+PyRtAudio_ringWrite(PyRtAudioObject *self, PyObject *args) {
+    return streamWrite(self, args, 0);
+}
 
-    self->_outputView = NULL;
-    if (hasOutputParams) { 
-        outputParams = populateStreamParameters(oparms);
-        if (!outputParams) {
-            PyErr_SetString(PyExc_AttributeError, "Error in output parameters");
-            return NULL;
-        }
-        self->_expectedOutputBufferLength = widthFromFormat(format);
-        self->_expectedOutputBufferLength *= outputParams->nChannels;
-        self->_expectedOutputBufferLength *= bframes;
-        self->_outputView = (Py_buffer *) malloc(sizeof(*(self->_outputView)));
-    }
-    if (hasInputParams) {
-        inputParams = populateStreamParameters(iparms);
-        if (!inputParams) {
-            PyErr_SetString(PyExc_AttributeError, "Error in input parameters");
-            return NULL;
-        }
-        self->_expectedInputBufferLength = widthFromFormat(format);
-        self->_expectedInputBufferLength *= inputParams->nChannels;
-        self->_expectedInputBufferLength *= bframes;
-    }
+static PyObject *
+PyRtAudio_ringRead(PyRtAudioObject *self, PyObject *args) {
+    return streamRead(self, args, 0);
+}
 
-    // decide which callback to use
-    RtAudioCallback cb;
-    if (outputParams && !inputParams) 
-        cb = __pyrtaudio_renderCallback;
-    else if (!outputParams && inputParams) 
-        cb = __pyrtaudio_captureCallback;
-    else if (outputParams && inputParams)
-        cb = __pyrtaudio_duplexCallback;
+static PyObject *
+PyRtAudio_write(PyRtAudioObject *self, PyObject *args) {
+    return streamWrite(self, args, 1);
+}
 
-    try {
-        self->_rt->openStream(outputParams, inputParams, format, srate, &bframes, cb, (void *) self);
-    } catch (RtError &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
-    }
+static PyObject *
+PyRtAudio_read(PyRtAudioObject *self, PyObject *args) {
+    return streamRead(self, args, 1);
+}
 
-    if (outputParams) delete outputParams;
-    if (inputParams)  delete inputParams;
+static PyObject *
+PyRtAudio_readinto(PyRtAudioObject *self, PyObject *args) {
+    Py_buffer view;
+    if (!PyArg_ParseTuple(args, "w*", &view))
+        return NULL;
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    acquireLock(self->_readLock);
+    Py_ssize_t frames = -1;
+    if (!self->_inputRing)
+        PyErr_SetString(PyExc_RuntimeError, "No input ring, open a ring mode stream with input first");
+    else
+        frames = ringReadFrames(self, (char *) view.buf, view.len, 1);
+    PyThread_release_lock(self->_readLock);
+    PyBuffer_Release(&view);
+
+    if (frames < 0) return NULL;
+    return Py_BuildValue("n", frames);
 }
 
 static PyObject *
-PyRtAudio_startStream(PyRtAudioObject *self) {
-    if (!self->_rt->isStreamOpen()) {
-        PyErr_SetString(PyExc_RuntimeError, "No open streams");
-        return NULL; //openStream was not called
-    }
-    if (self->_rt->isStreamRunning()) {
-        PyErr_SetString(PyExc_RuntimeError, "Stream already running");
-        return NULL; //stream is already running
+PyRtAudio_getDeadlineStats(PyRtAudioObject *self) {
+    PyRtDeadline *d = self->_deadline;
+    if (!d) {
+        PyErr_SetString(PyExc_RuntimeError, "No deadline mode stream is open");
+        return NULL;
     }
 
-    self->_rt->startStream();
+    // the oldest entries may be overwritten while they are read
+    static char const *kinds[] = { "gil", "callback", "xrun" };
+    unsigned long total = __atomic_load_n(&d->events, __ATOMIC_ACQUIRE);
+    unsigned long first = total > PYRT_DEADLINE_LOG ? total - PYRT_DEADLINE_LOG : 0;
+    PyObject *events = PyList_New(0);
+    if (!events) return NULL;
+    for (unsigned long i = first; i < total; i++) {
+        PyRtDeadlineEvent *e = &d->log[i % PYRT_DEADLINE_LOG];
+        PyObject *entry = Py_BuildValue("(ds)", e->streamTime, kinds[e->kind]);
+        if (!entry || PyList_Append(events, entry)) {
+            Py_XDECREF(entry);
+            Py_DECREF(events);
+            return NULL;
+        }
+        Py_DECREF(entry);
+    }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    return Py_BuildValue("{s:d,s:k,s:k,s:k,s:k,s:k,s:k,s:k,s:N}",
+            "budget", d->budgetNanos / 1e9,
+            "periods", __atomic_load_n(&d->periods, __ATOMIC_RELAXED),
+            "misses", __atomic_load_n(&d->misses, __ATOMIC_RELAXED),
+            "gil_misses", __atomic_load_n(&d->gilMisses, __ATOMIC_RELAXED),
+            "callback_misses", __atomic_load_n(&d->callbackMisses, __ATOMIC_RELAXED),
+            "late_played", __atomic_load_n(&d->latePlayed, __ATOMIC_RELAXED),
+            "late_dropped", __atomic_load_n(&d->lateDropped, __ATOMIC_RELAXED),
+            "xruns", __atomic_load_n(&d->xruns, __ATOMIC_RELAXED),
+            "events", events);
 }
 
 static PyObject *
-PyRtAudio_stopStream(PyRtAudioObject *self) {
-    if (!self->_rt->isStreamOpen()) {
-        PyErr_SetString(PyExc_RuntimeError, "No open streams");
-        return NULL;
-    }
-    if (!self->_rt->isStreamRunning()) {
-        PyErr_SetString(PyExc_RuntimeError, "Stream is not running");
+PyRtAudio_getRingStatus(PyRtAudioObject *self) {
+    if (!self->_ringDepth || (!self->_outputRing && !self->_inputRing)) {
+        PyErr_SetString(PyExc_RuntimeError, "No ring mode stream is open");
         return NULL;
     }
 
-    self->_rt->stopStream();
-
-    Py_INCREF(Py_None);
-    return Py_None;
+    unsigned long writable = 0, readable = 0;
+    if (self->_outputRing)
+        writable = ringWriteAvailable(self->_outputRing) / self->_outputFrameBytes;
+    if (self->_inputRing)
+        readable = ringReadAvailable(self->_inputRing) / self->_inputFrameBytes;
+
+    return Py_BuildValue("{s:I,s:I,s:k,s:k,s:k,s:k}",
+            "depth", self->_ringDepth,
+            "render_ahead", self->_ahead ? __atomic_load_n(&self->_ahead->target, __ATOMIC_RELAXED) : 0,
+            "write_available", writable,
+            "read_available", readable,
+            "underflows", __atomic_load_n(&self->_underflows, __ATOMIC_RELAXED),
+            "overflows", __atomic_load_n(&self->_overflows, __ATOMIC_RELAXED));
 }
 
 static PyObject *
-PyRtAudio_abortStream(PyRtAudioObject *self) {
-    if (!self->_rt->isStreamOpen()) {
-        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+PyRtAudio_setRenderAhead(PyRtAudioObject *self, PyObject *args) {
+    unsigned int periods;
+    if (!PyArg_ParseTuple(args, "I", &periods))
+        return NULL;
+
+    if (!self->_ahead) {
+        PyErr_SetString(PyExc_RuntimeError, "No render-ahead mode stream is open");
         return NULL;
     }
-    if (!self->_rt->isStreamRunning()) {
-        PyErr_SetString(PyExc_RuntimeError, "Stream is not running");
+    if (!periods || periods > self->_ringDepth) {
+        PyErr_Format(PyExc_ValueError, "render_ahead must be between 1 and the ring depth of %u",
+                self->_ringDepth);
         return NULL;
     }
 
-    self->_rt->abortStream();
+    // a lower target takes effect as the callback drains the queue, a
+    // higher one right away
+    __atomic_store_n(&self->_ahead->target, periods, __ATOMIC_RELEASE);
+    wakeRingWaiters(self);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
 static PyObject *
-PyRtAudio_closeStream(PyRtAudioObject *self) {
-    if (!self->_rt->isStreamOpen()) {
-        PyErr_SetString(PyExc_RuntimeError, "No open streams");
+PyRtAudio_getPlayStatus(PyRtAudioObject *self) {
+    PyRtFile *f = self->_file;
+    if (!f) {
+        PyErr_SetString(PyExc_RuntimeError, "No file is being played");
         return NULL;
     }
 
-    self->_rt->closeStream();
+    unsigned long position = __atomic_load_n(&f->position, __ATOMIC_ACQUIRE);
+    return Py_BuildValue("{s:k,s:k,s:I,s:I,s:O}",
+            "position", position,
+            "frames", (unsigned long) f->frames,
+            "rate", f->rate,
+            "channels", f->channels,
+            "done", position >= f->frames ? Py_True : Py_False);
+}
 
-    Py_INCREF(Py_None);
-    return Py_None;
+static PyObject *
+PyRtAudio_getRecordStats(PyRtAudioObject *self) {
+    PyRtRecorder *r = self->_recorder;
+    if (!r) {
+        PyErr_SetString(PyExc_RuntimeError, "No recording is being made");
+        return NULL;
+    }
+
+    unsigned long writes = __atomic_load_n(&r->writes, __ATOMIC_RELAXED);
+    long long total = __atomic_load_n(&r->writeNanosTotal, __ATOMIC_RELAXED);
+    uint64_t bytes = __atomic_load_n(&r->dataBytes, __ATOMIC_RELAXED);
+    int error = __atomic_load_n(&r->error, __ATOMIC_RELAXED);
+    PyObject *message = Py_None;
+    if (error) message = PyString_FromString(strerror(error));
+    else Py_INCREF(Py_None);
+    if (!message) return NULL;
+    return Py_BuildValue("{s:K,s:K,s:k,s:k,s:k,s:k,s:k,s:k,s:d,s:d,s:O,s:N}",
+            "frames", (unsigned long long) (bytes / r->frameBytes),
+            "bytes", (unsigned long long) bytes,
+            "queued_frames", (unsigned long) (ringReadAvailable(r->ring) / r->frameBytes),
+            "ring_frames", (unsigned long) (r->ring->size / r->frameBytes),
+            "ring_high_water", (unsigned long) (__atomic_load_n(&r->highWater, __ATOMIC_RELAXED) / r->frameBytes),
+            "overflows", __atomic_load_n(&r->overflows, __ATOMIC_RELAXED),
+            "xruns", __atomic_load_n(&r->xruns, __ATOMIC_RELAXED),
+            "writes", writes,
+            "write_latency_max", __atomic_load_n(&r->writeNanosMax, __ATOMIC_RELAXED) / 1e9,
+            "write_latency_mean", writes ? total / 1e9 / writes : 0.0,
+            "direct", r->direct ? Py_True : Py_False,
+            "error", message);
 }
 
 static PyMethodDef PyRtAudioObject_methods[] = {
@@ -436,6 +3025,15 @@ static PyMethodDef PyRtAudioObject_methods[] = {
         METH_NOARGS, "Return the number of audio devices present"},
     {"get_device_info", (PyCFunction) PyRtAudio_getDeviceInfo,
         METH_VARARGS, "Return the device info for this device index"},
+    {"get_all_device_info", (PyCFunction) PyRtAudio_getAllDeviceInfo,
+        METH_NOARGS, "Return the device info of all devices as a list. The devices are\n"
+            "only probed on the first call, later calls return the saved results\n"
+            "until invalidate_device_info() is called or a stream is opened"},
+    {"invalidate_device_info", (PyCFunction) PyRtAudio_invalidateDeviceInfo,
+        METH_NOARGS, "Make the next get_all_device_info() probe the devices again"},
+    {"set_probe_timeout", (PyCFunction) PyRtAudio_setProbeTimeout,
+        METH_VARARGS, "Set the seconds a device may take to be probed before it is reported\n"
+            "unprobed, 0 to wait as long as it takes. Devices are probed concurrently"},
     {"get_default_output_device", (PyCFunction) PyRtAudio_getDefaultOutputDevice,
         METH_NOARGS, "Return the default output device index"},
     {"get_default_input_device", (PyCFunction) PyRtAudio_getDefaultInputDevice,
@@ -450,8 +3048,101 @@ static PyMethodDef PyRtAudioObject_methods[] = {
         METH_NOARGS, "Return the current stream latency"},
     {"get_stream_sample_rate", (PyCFunction) PyRtAudio_getStreamSampleRate,
         METH_NOARGS, "Return the current stream sample rate"},
+    {"get_stats", (PyCFunction) PyRtAudio_getStats,
+        METH_NOARGS, "Return the performance counters of the open stream: periods, device\n"
+            "underflows and overflows, the time spent in the callback (total, max,\n"
+            "percentiles and a histogram of (shortest ns, count) buckets), in sample\n"
+            "conversion, blocked in the device and waiting for the GIL, and the load,\n"
+            "the mean and largest share of a period spent in callback and conversion.\n"
+            "Times are in nanoseconds; only ALSA streams count all but the GIL waits"},
+    {"reset_stats", (PyCFunction) PyRtAudio_resetStats,
+        METH_NOARGS, "Set the performance counters of the open stream back to zero"},
+    {"get_stream_memory", (PyCFunction) PyRtAudio_getStreamMemory,
+        METH_NOARGS, "Return the memory held by the open stream: user_bytes (output, input)\n"
+            "and device_bytes of its buffers, arena_bytes mapped for them (ALSA maps\n"
+            "them as one 64-byte aligned, prefaulted arena, and zero copy mode maps\n"
+            "each buffer it detaches on its own), whether they are all locked and\n"
+            "the arena on huge_pages (see RTAUDIO_HUGE_PAGES), and binding_bytes\n"
+            "of period buffers the ring, deadline, render-ahead and batch modes keep"},
+    {"start_trace", (PyCFunction) PyRtAudio_startTrace,
+        METH_VARARGS, "Record a timeline of the stream threads: wakeups, callbacks, sample\n"
+            "conversion, device reads and writes, xruns, GIL waits and python calls.\n"
+            "Each thread records into a preallocated ring of the given number of\n"
+            "events (65536 by default), which can only be resized with no stream open"},
+    {"stop_trace", (PyCFunction) PyRtAudio_stopTrace,
+        METH_VARARGS, "Stop recording the timeline, keeping what was recorded"},
+    {"dump_trace", (PyCFunction) PyRtAudio_dumpTrace,
+        METH_VARARGS, "Return the recorded timeline as Chrome trace / Perfetto JSON, or write it\n"
+            "to the given path. Timestamps are in microseconds of trace_clock()"},
+    {"trace_clock", (PyCFunction) PyRtAudio_traceClock,
+        METH_NOARGS, "Return the time in microseconds of the trace clock (CLOCK_MONOTONIC),\n"
+            "for lining application events up with the dumped timeline"},
+    {"get_stream_options", (PyCFunction) PyRtAudio_getStreamOptions,
+        METH_NOARGS, "Return the buffer_frames, number_of_buffers, flags, priority and\n"
+            "stream_name of the open stream as the device settled them"},
     {"open_stream", (PyCFunction) PyRtAudio_openStream,
-        METH_VARARGS, "Open an audio stream"},
+        METH_VARARGS, "Open an audio stream. An optional dict of options may follow the callback:\n"
+            "  zero_copy: pass the input to the callback as a read-only StreamBuffer\n"
+            "             wrapping the stream memory instead of a bytearray copy\n"
+            "  in_place:  call the callback as cb(output) or cb(input, output) with\n"
+            "             a writable StreamBuffer to fill in place; it returns None\n"
+            "             or 0 to continue, 1 to stop or 2 to abort the stream\n"
+            "  ring_depth: run the stream from lock-free rings of this many periods\n"
+            "             that python threads feed with write/read or ring_write/ring_read;\n"
+            "             the callback may be None and is never called.\n"
+            "             A None callback implies a ring_depth of 4, the most is 65536\n"
+            "  fast_callback: keep the callback thread's python thread state and\n"
+            "             argument tuple from period to period (default False); python\n"
+            "             thread-local state then persists across periods\n"
+            "  flags:      RTAUDIO_NONINTERLEAVED etc. or:ed together\n"
+            "  number_of_buffers: device buffers (ALSA periods), RTAUDIO_MINIMIZE_LATENCY\n"
+            "             asks for as few as possible\n"
+            "  priority:   callback thread priority with RTAUDIO_SCHEDULE_REALTIME\n"
+            "  stream_name: the name the stream is known by (JACK)\n"
+            "  typed:      StreamBuffers export samples of the stream format shaped\n"
+            "             (frames, channels), or (channels, frames) when non-interleaved,\n"
+            "             for numpy.asarray(); python 2 memoryviews cannot slice those.\n"
+            "             Returned arrays must have the same layout in any mode\n"
+            "  deadline:   run the callback on a worker thread and give it this share of\n"
+            "             a period (True for 0.75); periods it misses are concealed\n"
+            "  concealment: 'fade' (default) the last period out, 'repeat' it or 'silence'\n"
+            "  late_results: 'drop' (default) results that missed their period, or 'play'\n"
+            "             them in the next one instead of calling the callback again\n"
+            "  render_ahead: run the callback on a worker thread this many periods ahead\n"
+            "             of the device, queued in an output ring of ring_depth periods\n"
+            "             (default twice as many, at least 8). Output-only streams\n"
+            "  batch:      call the callback once every this many periods with a block\n"
+            "             of as many periods. get_stream_latency() includes the frames\n"
+            "             this adds: batch - 1 periods, or batch periods for duplex streams.\n"
+            "             The block is computed inside the device callback of a single\n"
+            "             period, so that period must fit a whole block's work: batch\n"
+            "             saves interpreter overhead but gives no extra headroom, and the\n"
+            "             device needs enough number_of_buffers to ride out the spike\n"
+            "  subinterpreter: 'module:function' to load into a subinterpreter of its own\n"
+            "             and use as the callback, which must be None then. The module\n"
+            "             must not start threads. Python 2 interpreters share the GIL,\n"
+            "             so this isolates the callback's state but not its timing\n"
+            "The callback may also be a native RtAudioCallback, given as an integer\n"
+            "address (e.g. a numba cfunc's .address) or as a ctypes function pointer.\n"
+            "RtAudio calls it directly and pyrtaudio takes no GIL around it; a ctypes\n"
+            "CFUNCTYPE wrapping a python function takes the GIL itself every period:\n"
+            "  int cb(void *output, void *input, unsigned int frames, double stream_time,\n"
+            "         unsigned int status, void *user_data)\n"
+            "  user_data: the address passed as its last argument, default NULL.\n"
+            "             which the caller keeps alive while the stream is open"},
+    {"autotune", (PyCFunction) PyRtAudio_autotune,
+        METH_VARARGS, "autotune(output, input, format, rate, callback[, options[, tuning]])\n"
+            "Find the lowest latency the callback keeps up with. Takes the arguments of\n"
+            "open_stream but the buffer size, and runs trial streams, which play what the\n"
+            "callback renders, from the largest period size and buffer count down while\n"
+            "they see no xruns and the callback takes at most headroom of a period. The\n"
+            "stream is left open, not started, in the configuration found. The tuning dict:\n"
+            "  max_frames, min_frames: period sizes tried, halving, default 1024 and 32\n"
+            "  max_buffers, min_buffers: buffer counts tried, default 4 and 2\n"
+            "  trial_seconds: how long each trial runs, default 1.0\n"
+            "  headroom:   the share of a period the callback may take, default 0.75\n"
+            "Returns a dict of buffer_frames, number_of_buffers, the buffered_frames\n"
+            "they add up to and the trials"},
     {"start_stream", (PyCFunction) PyRtAudio_startStream,
         METH_NOARGS, "Start an open audio stream"},
     {"stop_stream", (PyCFunction) PyRtAudio_stopStream,
@@ -460,6 +3151,56 @@ static PyMethodDef PyRtAudioObject_methods[] = {
         METH_NOARGS, "Abort a running audio stream (do not flush buffers)"},
     {"close_stream", (PyCFunction) PyRtAudio_closeStream,
         METH_NOARGS, "Close a stream. If the stream is running it will be stopped"},
+    {"ring_write", (PyCFunction) PyRtAudio_ringWrite,
+        METH_VARARGS, "Queue whole frames for output in ring mode, return the number of frames queued"},
+    {"ring_read", (PyCFunction) PyRtAudio_ringRead,
+        METH_VARARGS, "Take up to n frames of input in ring mode, return them as a bytearray"},
+    {"write", (PyCFunction) PyRtAudio_write,
+        METH_VARARGS, "Queue whole frames for output in ring mode, waiting for space without holding the GIL.\n"
+            "Returns the number of frames queued, which is short only if the stream is not running"},
+    {"read", (PyCFunction) PyRtAudio_read,
+        METH_VARARGS, "Take n frames of input in ring mode, waiting for them without holding the GIL.\n"
+            "Returns a bytearray, which is short only if the stream is not running"},
+    {"readinto", (PyCFunction) PyRtAudio_readinto,
+        METH_VARARGS, "Fill a writable buffer with whole frames of input in ring mode, waiting for them\n"
+            "without holding the GIL. Returns the number of frames read"},
+    {"get_deadline_stats", (PyCFunction) PyRtAudio_getDeadlineStats,
+        METH_NOARGS, "Return the deadline budget in seconds, the counters of missed, late and xrun\n"
+            "periods, and the last events as (stream time, 'gil'|'callback'|'xrun') tuples"},
+    {"get_ring_status", (PyCFunction) PyRtAudio_getRingStatus,
+        METH_NOARGS, "Return the ring fill levels and underflow/overflow counters in ring mode"},
+    {"play_file", (PyCFunction) PyRtAudio_playFile,
+        METH_VARARGS, "Play a WAV, RF64 or raw PCM file natively, without calling python per period.\n"
+            "The file is memory mapped and opens its own stream. An optional dict of options:\n"
+            "  device_id, first_channel: the output device, default the default one\n"
+            "  buffer_frames: the period size, default 512\n"
+            "  on_complete: called without arguments on the main thread once the file\n"
+            "             has played to its end\n"
+            "  rate, channels, format: the layout of a headerless file\n"
+            "  start:      start playing right away (default True)\n"
+            "The stream is closed with close_stream, or by the next play_file once done"},
+    {"get_play_status", (PyCFunction) PyRtAudio_getPlayStatus,
+        METH_NOARGS, "Return the position and length in frames, rate, channels and whether\n"
+            "the file played by play_file is done"},
+    {"record_file", (PyCFunction) PyRtAudio_recordFile,
+        METH_VARARGS, "Record to a WAV file natively, without calling python per period. The\n"
+            "callback queues the input in a ring which a writer thread drains to disk in\n"
+            "large aligned writes. close_stream finishes the file, which becomes an RF64\n"
+            "file past 4 GB. An existing file is only replaced once the stream is running.\n"
+            "An optional dict of options:\n"
+            "  device_id, first_channel: the input device, default the default one\n"
+            "  channels, rate, format: default 2, 48000 and RTAUDIO_SINT16\n"
+            "  buffer_frames: the period size, default 512\n"
+            "  ring_seconds: how much audio the ring holds, default 4\n"
+            "  preallocate_seconds: disk space reserved ahead at a time, default 60\n"
+            "  direct:     write with O_DIRECT where the file system supports it\n"
+            "  start:      start recording right away (default True)"},
+    {"get_record_stats", (PyCFunction) PyRtAudio_getRecordStats,
+        METH_NOARGS, "Return the frames recorded and queued, the ring size and high-water mark in\n"
+            "frames, dropped frames, xruns, and the number and latency of disk writes"},
+    {"set_render_ahead", (PyCFunction) PyRtAudio_setRenderAhead,
+        METH_VARARGS, "Change the number of periods the callback runs ahead in render-ahead mode,\n"
+            "also while the stream is running"},
     {NULL}
 };
 
@@ -509,7 +3250,55 @@ static PyTypeObject pyrtaudio_PyRtAudioType = {
 // end RtAudio implementation
 
 //module functions
+
+static PyObject *
+pyrtaudio_getKernelVariants(PyObject *module) {
+    std::vector<std::string> variants;
+    RtAudio::getKernelVariants(variants);
+    PyObject *names = PyList_New(variants.size());
+    if (!names) return NULL;
+    for (size_t i = 0; i < variants.size(); i++) {
+        PyObject *name = PyString_FromString(variants[i].c_str());
+        if (!name) {
+            Py_DECREF(names);
+            return NULL;
+        }
+        PyList_SET_ITEM(names, i, name);
+    }
+    return names;
+}
+
+static PyObject *
+pyrtaudio_getKernelVariant(PyObject *module) {
+    return PyString_FromString(RtAudio::getKernelVariant());
+}
+
+static PyObject *
+pyrtaudio_setKernelVariant(PyObject *module, PyObject *args) {
+    const char *variant = NULL;
+    if (!PyArg_ParseTuple(args, "|z", &variant))
+        return NULL;
+    if (!RtAudio::setKernelVariant(variant ? variant : "")) {
+        PyErr_Format(PyExc_ValueError, "kernel variant '%s' is unknown or not supported by this CPU", variant);
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
 static PyMethodDef pyrtaudio_functions[] = {
+    {"get_kernel_variants", (PyCFunction) pyrtaudio_getKernelVariants,
+        METH_NOARGS, "Return the instruction sets the sample conversion and byte swapping\n"
+            "kernels are built for that this CPU can run, the fastest first:\n"
+            "'avx512', 'avx2', 'sse2', 'neon' or 'scalar'"},
+    {"get_kernel_variant", (PyCFunction) pyrtaudio_getKernelVariant,
+        METH_NOARGS, "Return the kernel variant in use, the fastest one unless\n"
+            "set_kernel_variant() chose another"},
+    {"set_kernel_variant", (PyCFunction) pyrtaudio_setKernelVariant,
+        METH_VARARGS, "Make all streams convert with the named kernel variant from their next\n"
+            "buffer on, for comparing them; the samples are the same with each.\n"
+            "None goes back to the fastest one. Raises ValueError for a variant\n"
+            "the build or the CPU does not have"},
     {NULL}
 };
 
@@ -526,6 +3315,10 @@ PyMODINIT_FUNC initpyrtaudio(void) {
     //pyrtaudio_PyRtAudioDeviceInfoType.tp_methods = PyRtAudioDeviceInfoObject_methods;
     
     if (PyType_Ready(&pyrtaudio_PyRtAudioType) < 0) return;
+    if (PyType_Ready(&pyrtaudio_PyRtAudioBufferType) < 0) return;
+
+    // the callbacks enter the interpreter from the RtApi thread
+    PyEval_InitThreads();
 
     m = Py_InitModule3("pyrtaudio", pyrtaudio_functions, "RtAudio python bindings");
     if (m == NULL) return;
@@ -546,17 +3339,48 @@ PyMODINIT_FUNC initpyrtaudio(void) {
     PyModule_AddObject(m, "RTAUDIO_SINT32", PyRtAudio_SINT32);
     Py_INCREF(PyRtAudio_SINT32);
 
-    //PyRtAudio_FLOAT32 = PyLong_FromUnsignedLong(RTAUDIO_FLOAT32);
-    //PyModule_AddObject(m, "RTAUDIO_FLOAT32", PyRtAudio_FLOAT32);
-    //Py_INCREF(PyRtAudio_FLOAT32);
+    PyRtAudio_FLOAT32 = PyLong_FromUnsignedLong(RTAUDIO_FLOAT32);
+    PyModule_AddObject(m, "RTAUDIO_FLOAT32", PyRtAudio_FLOAT32);
+    Py_INCREF(PyRtAudio_FLOAT32);
 
-    //PyRtAudio_FLOAT64 = PyLong_FromUnsignedLong(RTAUDIO_FLOAT64);
-    //PyModule_AddObject(m, "RTAUDIO_FLOAT64", PyRtAudio_FLOAT64);
-    //Py_INCREF(PyRtAudio_FLOAT64);
+    PyRtAudio_FLOAT64 = PyLong_FromUnsignedLong(RTAUDIO_FLOAT64);
+    PyModule_AddObject(m, "RTAUDIO_FLOAT64", PyRtAudio_FLOAT64);
+    Py_INCREF(PyRtAudio_FLOAT64);
+
+    PyRtAudio_NONINTERLEAVED = PyLong_FromUnsignedLong(RTAUDIO_NONINTERLEAVED);
+    PyModule_AddObject(m, "RTAUDIO_NONINTERLEAVED", PyRtAudio_NONINTERLEAVED);
+    Py_INCREF(PyRtAudio_NONINTERLEAVED);
+
+    PyRtAudio_MINIMIZE_LATENCY = PyLong_FromUnsignedLong(RTAUDIO_MINIMIZE_LATENCY);
+    PyModule_AddObject(m, "RTAUDIO_MINIMIZE_LATENCY", PyRtAudio_MINIMIZE_LATENCY);
+    Py_INCREF(PyRtAudio_MINIMIZE_LATENCY);
+
+    PyRtAudio_HOG_DEVICE = PyLong_FromUnsignedLong(RTAUDIO_HOG_DEVICE);
+    PyModule_AddObject(m, "RTAUDIO_HOG_DEVICE", PyRtAudio_HOG_DEVICE);
+    Py_INCREF(PyRtAudio_HOG_DEVICE);
+
+    PyRtAudio_SCHEDULE_REALTIME = PyLong_FromUnsignedLong(RTAUDIO_SCHEDULE_REALTIME);
+    PyModule_AddObject(m, "RTAUDIO_SCHEDULE_REALTIME", PyRtAudio_SCHEDULE_REALTIME);
+    Py_INCREF(PyRtAudio_SCHEDULE_REALTIME);
+
+    PyRtAudio_ALSA_USE_DEFAULT = PyLong_FromUnsignedLong(RTAUDIO_ALSA_USE_DEFAULT);
+    PyModule_AddObject(m, "RTAUDIO_ALSA_USE_DEFAULT", PyRtAudio_ALSA_USE_DEFAULT);
+    Py_INCREF(PyRtAudio_ALSA_USE_DEFAULT);
+
+    PyRtAudio_HUGE_PAGES = PyLong_FromUnsignedLong(RTAUDIO_HUGE_PAGES);
+    PyModule_AddObject(m, "RTAUDIO_HUGE_PAGES", PyRtAudio_HUGE_PAGES);
+    Py_INCREF(PyRtAudio_HUGE_PAGES);
+
+    PyRtAudio_noArgs = PyTuple_New(0);
 
     Py_INCREF(&pyrtaudio_PyRtAudioType);
     PyModule_AddObject(m, "RtAudio", 
             (PyObject *) &pyrtaudio_PyRtAudioType);
+
+    // a cast inside Py_INCREF would still break strict aliasing
+    PyObject *bufferType = (PyObject *) &pyrtaudio_PyRtAudioBufferType;
+    Py_INCREF(bufferType);
+    PyModule_AddObject(m, "StreamBuffer", bufferType);
 }
 
 #ifdef __cplusplus
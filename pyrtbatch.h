@@ -0,0 +1,87 @@
+#ifndef _PYRTBATCH_
+#define _PYRTBATCH_
+
+#include <stdlib.h>
+#include <string.h>
+#include "RtAudio.h"
+
+// In batch mode the device period stays small but the python callback is
+// only called every few periods, on a block of that many periods. The
+// blocks are assembled and taken apart one period at a time by the
+// RtAudio callback, so the callback latency grows with the batch size
+// (see batchLatency). Python still runs synchronously on the RtAudio
+// thread, in the one period that starts or completes a block, so batching
+// amortizes the interpreter entry but does not decouple the block's work
+// from the device deadline the way the deadline worker does.
+
+typedef struct {
+    unsigned int periods;      // periods per block
+    unsigned int frames;       // frames per period
+    unsigned int index;        // the period of the block the device is at
+    unsigned int stopAfter;    // periods left to play before a requested stop
+    double streamTime;         // stream time of the block's first period
+    RtAudioStreamStatus status; // xruns seen while the block was assembled
+    char *in;                  // malloc'ed, may be handed to python
+    char *out;
+    size_t inLen;              // length of one period, not of the block
+    size_t outLen;
+    unsigned int inChannels;
+    unsigned int outChannels;
+    int planar;
+} PyRtBatch;
+
+inline void batchDestroy(PyRtBatch *b) {
+    if (!b) return;
+    free(b->in);
+    free(b->out);
+    free(b);
+}
+
+inline PyRtBatch *batchCreate(unsigned int periods, unsigned int frames, size_t inLen, size_t outLen,
+        unsigned int inChannels, unsigned int outChannels, int planar) {
+    PyRtBatch *b = (PyRtBatch *) calloc(1, sizeof(PyRtBatch));
+    if (!b) return NULL;
+    b->periods = periods;
+    b->frames = frames;
+    b->inLen = inLen;
+    b->outLen = outLen;
+    b->inChannels = inChannels;
+    b->outChannels = outChannels;
+    b->planar = planar;
+    // the first block of a duplex stream is played before python filled it
+    b->in = (char *) calloc(periods, inLen ? inLen : 1);
+    b->out = (char *) calloc(periods, outLen ? outLen : 1);
+    if (!b->in || !b->out) {
+        batchDestroy(b);
+        return NULL;
+    }
+    return b;
+}
+
+// Copies period index of a block from or to the device buffer. A
+// non-interleaved block keeps each channel contiguous over all its periods.
+inline void batchCopy(PyRtBatch *b, char *block, char *period, size_t len,
+        unsigned int channels, int toBlock) {
+    if (!b->planar) {
+        char *slot = block + b->index * len;
+        memcpy(toBlock ? slot : period, toBlock ? period : slot, len);
+        return;
+    }
+    size_t channelLen = len / channels;
+    for (unsigned int c = 0; c < channels; c++) {
+        char *slot = block + (c * b->periods + b->index) * channelLen;
+        char *part = period + c * channelLen;
+        memcpy(toBlock ? slot : part, toBlock ? part : slot, channelLen);
+    }
+}
+
+// Frames python is ahead of or behind the device. Rendered periods wait up
+// to periods - 1 to be played, captured ones as long to be handed over, and
+// a duplex stream plays each block one block after its input was taken.
+inline long batchLatency(PyRtBatch *b) {
+    if (b->inLen && b->outLen)
+        return (long) b->periods * b->frames;
+    return (long) (b->periods - 1) * b->frames;
+}
+
+#endif
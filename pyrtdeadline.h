@@ -0,0 +1,190 @@
+#ifndef _PYRTDEADLINE_
+#define _PYRTDEADLINE_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "RtAudio.h"
+
+// In deadline mode the python callback runs on a worker thread. Each
+// period the RtAudio callback hands the worker a job and waits for it only
+// as long as the budget allows. If the worker is late the device gets a
+// concealment buffer instead, and the late result is played or dropped
+// once it arrives.
+
+enum {
+    PYRT_CONCEAL_SILENCE,
+    PYRT_CONCEAL_REPEAT,       // repeat the last period python delivered
+    PYRT_CONCEAL_FADE          // fade the last period out, then silence
+};
+
+enum {
+    PYRT_JOB_IDLE,
+    PYRT_JOB_RUNNING,          // handed to the worker
+    PYRT_JOB_DONE              // the worker is finished, the result waits
+};
+
+// what a logged event was caused by
+enum {
+    PYRT_MISS_GIL,             // the worker could not get the GIL in time
+    PYRT_MISS_CALLBACK,        // the python callback itself ran too long
+    PYRT_MISS_XRUN             // the device reported an under- or overflow
+};
+
+#define PYRT_DEADLINE_LOG 64
+
+typedef struct {
+    double streamTime;
+    int kind;
+} PyRtDeadlineEvent;
+
+typedef struct {
+    pthread_t worker;
+    int running;               // the worker thread exists
+    int quit;
+    sem_t jobSem;              // posted by the audio thread for each job
+    sem_t doneSem;             // posted by the worker for each finished job
+
+    // the job, owned by the worker while it is running
+    int state;
+    char *in;                  // malloc'ed, may be handed to python
+    char *out;
+    double streamTime;
+    RtAudioStreamStatus status;
+    int retcode;
+    int gilAcquired;           // the worker got into the interpreter
+
+    // layout and policy, fixed while the stream is open
+    size_t inLen;
+    size_t outLen;
+    unsigned int frames;
+    unsigned int channels;
+    RtAudioFormat format;
+    int planar;
+    long budgetNanos;
+    int concealment;
+    int playLate;              // play late results instead of dropping them
+    char *last;                // the last period python delivered
+    int concealedRun;          // consecutive concealed periods
+
+    // statistics, written by the audio thread only
+    unsigned long periods;
+    unsigned long misses;
+    unsigned long gilMisses;
+    unsigned long callbackMisses;
+    unsigned long latePlayed;
+    unsigned long lateDropped;
+    unsigned long xruns;
+    unsigned long events;      // total events logged, the log keeps the last ones
+    PyRtDeadlineEvent log[PYRT_DEADLINE_LOG];
+} PyRtDeadline;
+
+inline void deadlineDestroy(PyRtDeadline *d) {
+    if (!d) return;
+    sem_destroy(&d->jobSem);
+    sem_destroy(&d->doneSem);
+    free(d->in);
+    free(d->out);
+    free(d->last);
+    free(d);
+}
+
+inline PyRtDeadline *deadlineCreate(size_t inLen, size_t outLen, unsigned int frames,
+        unsigned int channels, RtAudioFormat format, int planar) {
+    PyRtDeadline *d = (PyRtDeadline *) calloc(1, sizeof(PyRtDeadline));
+    if (!d) return NULL;
+    sem_init(&d->jobSem, 0, 0);
+    sem_init(&d->doneSem, 0, 0);
+    d->inLen = inLen;
+    d->outLen = outLen;
+    d->frames = frames;
+    d->channels = channels;
+    d->format = format;
+    d->planar = planar;
+    // calloc also gives the first repeat or fade silence to work on
+    d->in = (char *) calloc(1, inLen ? inLen : 1);
+    d->out = (char *) calloc(1, outLen);
+    d->last = (char *) calloc(1, outLen);
+    if (!d->in || !d->out || !d->last) {
+        deadlineDestroy(d);
+        return NULL;
+    }
+    return d;
+}
+
+inline void deadlineLog(PyRtDeadline *d, double streamTime, int kind) {
+    PyRtDeadlineEvent *e = &d->log[d->events % PYRT_DEADLINE_LOG];
+    e->streamTime = streamTime;
+    e->kind = kind;
+    __atomic_store_n(&d->events, d->events + 1, __ATOMIC_RELEASE);
+}
+
+template <typename T>
+inline void fadeSamples(T *buf, unsigned int frames, unsigned int channels, int planar) {
+    for (unsigned int i = 0; i < frames * channels; i++) {
+        unsigned int frame = planar ? i % frames : i / channels;
+        buf[i] = (T) (buf[i] * ((double) (frames - frame) / frames));
+    }
+}
+
+// linear fade to zero over one period
+inline void fadeBuffer(char *buf, RtAudioFormat format, unsigned int frames,
+        unsigned int channels, int planar) {
+    switch (format) {
+        case RTAUDIO_SINT8:
+            fadeSamples((int8_t *) buf, frames, channels, planar);
+            break;
+        case RTAUDIO_SINT16:
+            fadeSamples((int16_t *) buf, frames, channels, planar);
+            break;
+        case RTAUDIO_SINT24:
+        case RTAUDIO_SINT32:
+            fadeSamples((int32_t *) buf, frames, channels, planar);
+            break;
+        case RTAUDIO_FLOAT32:
+            fadeSamples((float *) buf, frames, channels, planar);
+            break;
+        case RTAUDIO_FLOAT64:
+            fadeSamples((double *) buf, frames, channels, planar);
+            break;
+    }
+}
+
+// fills the device buffer for a period python missed
+inline void deadlineConceal(PyRtDeadline *d, char *output) {
+    int run = d->concealedRun++;
+    if (d->concealment == PYRT_CONCEAL_REPEAT) {
+        memcpy(output, d->last, d->outLen);
+    } else if (d->concealment == PYRT_CONCEAL_FADE && run == 0) {
+        memcpy(output, d->last, d->outLen);
+        fadeBuffer(output, d->format, d->frames, d->channels, d->planar);
+    } else {
+        memset(output, 0, d->outLen);
+    }
+}
+
+// hands over a finished job's output
+inline void deadlineDeliver(PyRtDeadline *d, char *output) {
+    memcpy(output, d->out, d->outLen);
+    if (d->concealment != PYRT_CONCEAL_SILENCE)
+        memcpy(d->last, d->out, d->outLen);
+    d->concealedRun = 0;
+}
+
+// waits for the worker until the budget counted from start has passed
+inline int deadlineWait(PyRtDeadline *d, struct timespec *start) {
+    struct timespec deadline = *start;
+    deadline.tv_nsec += d->budgetNanos;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    while (sem_timedwait(&d->doneSem, &deadline)) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+#endif
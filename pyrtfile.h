@@ -0,0 +1,169 @@
+#ifndef _PYRTFILE_
+#define _PYRTFILE_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "RtAudio.h"
+
+// Native file playback: the file is mapped into memory and the RtAudio
+// callback copies each period straight from the mapping, converting only
+// what RtAudio has no format for. WAV, RF64 and headerless PCM files are
+// supported; samples are expected in little endian order.
+
+enum {
+    PYRT_FILE_COPY,            // samples are in an RtAudio format already
+    PYRT_FILE_U8,              // unsigned 8 bit, played as RTAUDIO_SINT8
+    PYRT_FILE_S24              // packed 24 bit, played as RTAUDIO_SINT32
+};
+
+// the on_complete callable, owned by whoever fires or releases it
+typedef struct {
+    PyObject *callback;
+} PyRtCompletion;
+
+typedef struct {
+    char *map;
+    size_t mapLen;
+    char const *data;          // first sample frame
+    size_t frames;             // frames in the file
+    size_t position;           // frames played, written by the callback
+    unsigned int fileFrameBytes;
+    unsigned int channels;
+    unsigned int rate;
+    RtAudioFormat format;      // the stream format
+    int encoding;
+    PyRtCompletion *completion; // NULL without on_complete
+    int fired;                 // the completion was handed to the main thread
+} PyRtFile;
+
+inline uint32_t fileLE32(unsigned char const *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+inline uint16_t fileLE16(unsigned char const *p) {
+    return p[0] | (p[1] << 8);
+}
+
+// Finds the fmt and data chunks. Returns an error message, or NULL once
+// data, frames, channels, rate, format and encoding are filled in.
+inline char const *fileParseWav(PyRtFile *f) {
+    unsigned char const *p = (unsigned char const *) f->map;
+    size_t len = f->mapLen;
+    int rf64 = !memcmp(p, "RF64", 4);
+    uint64_t rf64DataLen = 0;
+    unsigned int tag = 0, bits = 0, blockAlign = 0;
+    size_t dataLen = 0;
+
+    f->data = NULL;
+    for (size_t at = 12; at + 8 <= len; ) {
+        unsigned char const *chunk = p + at;
+        size_t size = fileLE32(chunk + 4);
+        size_t body = at + 8;
+        if (!memcmp(chunk, "ds64", 4) && size >= 16 && body + 16 <= len) {
+            rf64DataLen = fileLE32(chunk + 16) | ((uint64_t) fileLE32(chunk + 20) << 32);
+        } else if (!memcmp(chunk, "fmt ", 4) && size >= 16 && body + 16 <= len) {
+            tag = fileLE16(chunk + 8);
+            f->channels = fileLE16(chunk + 10);
+            f->rate = fileLE32(chunk + 12);
+            blockAlign = fileLE16(chunk + 20);
+            bits = fileLE16(chunk + 22);
+            // WAVE_FORMAT_EXTENSIBLE keeps the actual tag in its subformat
+            if (tag == 0xFFFE && size >= 40 && body + 40 <= len)
+                tag = fileLE16(chunk + 32);
+        } else if (!memcmp(chunk, "data", 4)) {
+            f->data = (char const *) chunk + 8;
+            dataLen = rf64 && size == 0xFFFFFFFF ? (size_t) rf64DataLen : size;
+            // a header written before the length was known
+            if (dataLen > len - body || !dataLen) dataLen = len - body;
+            break;
+        }
+        at = body + size + (size & 1);
+    }
+
+    if (!f->data) return "The file has no data chunk";
+    if (!tag || !f->channels || !blockAlign) return "The file has no usable fmt chunk";
+
+    f->encoding = PYRT_FILE_COPY;
+    if (tag == 1 && bits == 8) {
+        f->format = RTAUDIO_SINT8;
+        f->encoding = PYRT_FILE_U8;
+    } else if (tag == 1 && bits == 16) {
+        f->format = RTAUDIO_SINT16;
+    } else if (tag == 1 && bits == 24) {
+        f->format = RTAUDIO_SINT32;
+        f->encoding = PYRT_FILE_S24;
+    } else if (tag == 1 && bits == 32) {
+        f->format = RTAUDIO_SINT32;
+    } else if (tag == 3 && bits == 32) {
+        f->format = RTAUDIO_FLOAT32;
+    } else if (tag == 3 && bits == 64) {
+        f->format = RTAUDIO_FLOAT64;
+    } else {
+        return "Unsupported WAV sample format";
+    }
+    if (blockAlign != f->channels * (bits / 8)) return "Unsupported WAV block alignment";
+    f->fileFrameBytes = blockAlign;
+    f->frames = dataLen / blockAlign;
+    return NULL;
+}
+
+inline int fileIsWav(PyRtFile *f) {
+    return f->mapLen >= 12 && (!memcmp(f->map, "RIFF", 4) || !memcmp(f->map, "RF64", 4)) &&
+        !memcmp(f->map + 8, "WAVE", 4);
+}
+
+// maps the file and tells the kernel it is read front to back
+inline int fileMap(PyRtFile *f, char const *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    int failed = fstat(fd, &st);
+    if (!failed && !st.st_size) {
+        errno = EINVAL;
+        failed = 1;
+    }
+    if (failed) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    // starts reading ahead now instead of faulting in the callback
+    madvise(map, st.st_size, MADV_WILLNEED);
+    f->map = (char *) map;
+    f->mapLen = st.st_size;
+    return 0;
+}
+
+inline void fileDestroy(PyRtFile *f) {
+    if (!f) return;
+    if (f->map) munmap(f->map, f->mapLen);
+    free(f);
+}
+
+// copies frames of the file from position pos into a user buffer
+inline void fileCopy(PyRtFile *f, char *out, size_t pos, size_t frames) {
+    char const *src = f->data + pos * f->fileFrameBytes;
+    size_t samples = frames * f->channels;
+    if (f->encoding == PYRT_FILE_COPY) {
+        memcpy(out, src, frames * f->fileFrameBytes);
+    } else if (f->encoding == PYRT_FILE_U8) {
+        for (size_t i = 0; i < samples; i++)
+            out[i] = (char) (src[i] ^ 0x80);
+    } else {
+        unsigned char const *s = (unsigned char const *) src;
+        int32_t *o = (int32_t *) out;
+        for (size_t i = 0; i < samples; i++, s += 3)
+            o[i] = (int32_t) ((uint32_t) s[0] << 8 | (uint32_t) s[1] << 16 | (uint32_t) s[2] << 24);
+    }
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef _PYRTRECORD_
+#define _PYRTRECORD_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "RtAudio.h"
+#include "pyrtring.h"
+
+// Native recording: the RtAudio callback only copies each period into a
+// large ring, and a writer thread drains the ring to disk in big aligned
+// blocks. The file starts with a header block of PYRT_RECORD_HEADER bytes,
+// padded with a JUNK chunk, so the sample data stays block aligned for
+// O_DIRECT and the header can turn into an RF64 one in place once the data
+// outgrows the 4 GB a WAV file can describe. Recording starts in a temporary
+// file next to the target, which only replaces it once the stream is running,
+// so a recording that fails to start leaves an existing file alone.
+
+#define PYRT_RECORD_HEADER 4096
+#define PYRT_RECORD_CHUNK (256 * 1024)
+
+typedef struct {
+    pthread_t writer;
+    int running;               // the writer thread exists
+    int quit;
+    sem_t sem;                 // posted by the callback once a chunk is queued
+    int waiting;               // the writer sleeps on sem
+    PyRtRing *ring;
+
+    // the file, only touched by the writer once it runs
+    int fd;
+    char *path;                // the file the recording ends up in
+    char *tempPath;            // the file written until recorderCommit, NULL after
+    int direct;                // opened with O_DIRECT
+    char *block;               // aligned staging buffer of PYRT_RECORD_CHUNK bytes
+    uint64_t dataBytes;        // sample bytes written so far
+    uint64_t allocated;        // bytes reserved with fallocate
+    uint64_t preallocate;      // bytes reserved at a time, 0 for none
+
+    RtAudioFormat format;
+    unsigned int channels;
+    unsigned int rate;
+    unsigned int frameBytes;
+
+    // statistics
+    unsigned long overflows;   // frames the callback could not queue
+    unsigned long xruns;       // periods the device reported an overflow for
+    size_t highWater;          // the most bytes ever queued, written by the callback only
+    unsigned long writes;
+    long writeNanosMax;
+    long long writeNanosTotal;
+    int error;                 // errno of the first failed write, 0 if none
+} PyRtRecorder;
+
+inline void recordPut16(char *p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+}
+
+inline void recordPut32(char *p, uint32_t v) {
+    recordPut16(p, v); recordPut16(p + 2, v >> 16);
+}
+
+inline void recordPut64(char *p, uint64_t v) {
+    recordPut32(p, v); recordPut32(p + 4, v >> 32);
+}
+
+// fills a zeroed header block for the data written so far
+inline void recordHeader(PyRtRecorder *r, char *h) {
+    uint64_t data = r->dataBytes;
+    uint64_t riff = PYRT_RECORD_HEADER - 8 + data + (data & 1);
+    int rf64 = riff > 0xFFFFFFFFu;
+
+    memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+    recordPut32(h + 4, rf64 ? 0xFFFFFFFFu : riff);
+    memcpy(h + 8, "WAVE", 4);
+    char *c = h + 12;
+    if (rf64) {
+        memcpy(c, "ds64", 4);
+        recordPut32(c + 4, 28);
+        recordPut64(c + 8, riff);
+        recordPut64(c + 16, data);
+        recordPut64(c + 24, data / r->frameBytes);
+        c += 36;
+    }
+
+    // pads up to the fmt and data chunks at the end of the block
+    size_t junk = PYRT_RECORD_HEADER - (c - h) - 8 - 24 - 8;
+    memcpy(c, "JUNK", 4);
+    recordPut32(c + 4, junk);
+    c += 8 + junk;
+
+    int isFloat = r->format == RTAUDIO_FLOAT32 || r->format == RTAUDIO_FLOAT64;
+    unsigned int width = r->frameBytes / r->channels;
+    memcpy(c, "fmt ", 4);
+    recordPut32(c + 4, 16);
+    recordPut16(c + 8, isFloat ? 3 : 1);
+    recordPut16(c + 10, r->channels);
+    recordPut32(c + 12, r->rate);
+    recordPut32(c + 16, r->rate * r->frameBytes);
+    recordPut16(c + 20, r->frameBytes);
+    recordPut16(c + 22, width * 8);
+    c += 24;
+
+    memcpy(c, "data", 4);
+    recordPut32(c + 4, rf64 ? 0xFFFFFFFFu : data);
+}
+
+inline int recordWriteHeader(PyRtRecorder *r) {
+    memset(r->block, 0, PYRT_RECORD_HEADER);
+    recordHeader(r, r->block);
+    return pwrite(r->fd, r->block, PYRT_RECORD_HEADER, 0) == PYRT_RECORD_HEADER ? 0 : -1;
+}
+
+inline long recordElapsed(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000L + now.tv_nsec - start->tv_nsec;
+}
+
+// writes len bytes of the staging buffer after the data written so far
+inline void recordWrite(PyRtRecorder *r, size_t len) {
+    // WAV stores 8 bit samples unsigned
+    if (r->format == RTAUDIO_SINT8)
+        for (size_t i = 0; i < len; i++) r->block[i] ^= 0x80;
+
+    uint64_t offset = PYRT_RECORD_HEADER + r->dataBytes;
+    while (r->preallocate && offset + len > r->allocated) {
+        // failing to reserve space is not an error, writing is, so a file
+        // system that cannot reserve it is not asked again
+        if (fallocate(r->fd, FALLOC_FL_KEEP_SIZE, r->allocated, r->preallocate)) {
+            r->preallocate = 0;
+            break;
+        }
+        r->allocated += r->preallocate;
+    }
+
+    // O_DIRECT only writes whole blocks, the tail is truncated on close
+    size_t size = len;
+    if (r->direct && size % PYRT_RECORD_HEADER) {
+        size_t padded = (size + PYRT_RECORD_HEADER - 1) / PYRT_RECORD_HEADER * PYRT_RECORD_HEADER;
+        memset(r->block + size, 0, padded - size);
+        size = padded;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ssize_t done = r->error ? -1 : pwrite(r->fd, r->block, size, offset);
+    long nanos = recordElapsed(&start);
+    if (done != (ssize_t) size) {
+        if (!r->error) r->error = done < 0 ? errno : ENOSPC;
+        return;
+    }
+    __atomic_store_n(&r->dataBytes, r->dataBytes + len, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->writes, r->writes + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->writeNanosTotal, r->writeNanosTotal + nanos, __ATOMIC_RELAXED);
+    if (nanos > r->writeNanosMax)
+        __atomic_store_n(&r->writeNanosMax, nanos, __ATOMIC_RELAXED);
+}
+
+// the header goes last, once the length is known
+inline void recordFinish(PyRtRecorder *r) {
+    // chunks are padded to an even length, truncating extends with zeros
+    uint64_t end = PYRT_RECORD_HEADER + r->dataBytes + (r->dataBytes & 1);
+    if (ftruncate(r->fd, end) && !r->error) r->error = errno;
+    if (recordWriteHeader(r) && !r->error) r->error = errno;
+}
+
+// The writer thread. It waits for a chunk to be queued, or for the stream
+// to be closed, in which case it writes out what is left.
+inline void *recordWriter(void *ptr) {
+    PyRtRecorder *r = (PyRtRecorder *) ptr;
+
+    while (1) {
+        int quit = __atomic_load_n(&r->quit, __ATOMIC_ACQUIRE);
+        size_t queued = ringReadAvailable(r->ring);
+        if (queued >= PYRT_RECORD_CHUNK || (quit && queued)) {
+            size_t len = queued < PYRT_RECORD_CHUNK ? queued : PYRT_RECORD_CHUNK;
+            ringRead(r->ring, r->block, len);
+            recordWrite(r, len);
+            continue;
+        }
+        if (quit) break;
+
+        // publish the waiter before rechecking so a post cannot be missed
+        __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+        if (ringReadAvailable(r->ring) >= PYRT_RECORD_CHUNK) continue;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (sem_timedwait(&r->sem, &deadline) && errno == EINTR)
+            ;
+        __atomic_store_n(&r->waiting, 0, __ATOMIC_RELEASE);
+    }
+
+    recordFinish(r);
+    return NULL;
+}
+
+inline void recorderDestroy(PyRtRecorder *r) {
+    if (!r) return;
+    if (r->fd >= 0) close(r->fd);
+    // a recording that never started takes its temporary file with it
+    if (r->tempPath) unlink(r->tempPath);
+    free(r->tempPath);
+    free(r->path);
+    ringDestroy(r->ring);
+    free(r->block);
+    sem_destroy(&r->sem);
+    free(r);
+}
+
+// Creates a file next to path that no other one has, 0 or -1 with errno set.
+inline int recordOpenTemp(PyRtRecorder *r, int flags) {
+    size_t size = strlen(r->path) + 32;
+    if (!(r->tempPath = (char *) malloc(size))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (unsigned int n = 0; n < 100; n++) {
+        snprintf(r->tempPath, size, "%s.%ld.%u.part", r->path, (long) getpid(), n);
+        r->fd = open(r->tempPath, flags | O_CREAT | O_EXCL, 0666);
+        if (r->fd >= 0) return 0;
+        if (errno != EEXIST) break;
+    }
+    int saved = errno;
+    free(r->tempPath);
+    r->tempPath = NULL;
+    errno = saved;
+    return -1;
+}
+
+// Moves the recording into place, 0 or -1 with errno set. The writer keeps
+// writing through the same descriptor.
+inline int recorderCommit(PyRtRecorder *r) {
+    if (rename(r->tempPath, r->path)) return -1;
+    free(r->tempPath);
+    r->tempPath = NULL;
+    return 0;
+}
+
+// Creates the temporary file with an empty header. Returns NULL with errno set.
+inline PyRtRecorder *recorderCreate(char const *path, int direct, RtAudioFormat format,
+        unsigned int channels, unsigned int rate, unsigned int frameBytes, size_t ringBytes,
+        uint64_t preallocate) {
+    PyRtRecorder *r = (PyRtRecorder *) calloc(1, sizeof(PyRtRecorder));
+    if (!r) return NULL;
+    sem_init(&r->sem, 0, 0);
+    r->fd = -1;
+    r->format = format;
+    r->channels = channels;
+    r->rate = rate;
+    r->frameBytes = frameBytes;
+    r->preallocate = preallocate;
+
+    void *mem = NULL;
+    // whole frames only, so the callback never splits one
+    ringBytes -= ringBytes % frameBytes;
+    if (posix_memalign(&mem, PYRT_RECORD_HEADER, PYRT_RECORD_CHUNK) ||
+            !(r->ring = ringCreate(ringBytes))) {
+        free(mem);
+        recorderDestroy(r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    r->block = (char *) mem;
+    if (!(r->path = strdup(path))) {
+        recorderDestroy(r);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // not every file system supports O_DIRECT, those get buffered writes
+    if (!recordOpenTemp(r, O_WRONLY) && direct)
+        r->direct = fcntl(r->fd, F_SETFL, O_DIRECT) == 0;
+    if (r->fd < 0 || recordWriteHeader(r)) {
+        int saved = errno;
+        recorderDestroy(r);
+        errno = saved;
+        return NULL;
+    }
+    return r;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _PYRTRING_
+#define _PYRTRING_
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PYRT_CACHE_LINE 64
+// the most periods a stream ring may hold, well past any useful latency
+#define PYRT_RING_MAX_DEPTH 65536
+
+// A lock-free single-producer/single-consumer byte ring. head and tail
+// count the bytes ever written and read, so the fill level is head - tail
+// and no slot has to be kept free. Each index lives on its own cache line
+// and is only stored to by its owner: the producer publishes head after
+// copying, the consumer publishes tail after copying.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t head __attribute__((aligned(PYRT_CACHE_LINE))); // written by the producer
+    size_t tail __attribute__((aligned(PYRT_CACHE_LINE))); // written by the consumer
+} PyRtRing;
+
+inline PyRtRing *ringCreate(size_t size) {
+    void *mem = NULL;
+    if (posix_memalign(&mem, PYRT_CACHE_LINE, sizeof(PyRtRing)))
+        return NULL;
+    PyRtRing *ring = (PyRtRing *) mem;
+    if (posix_memalign(&mem, PYRT_CACHE_LINE, size)) {
+        free(ring);
+        return NULL;
+    }
+    // touch the memory now rather than in the callback
+    memset(mem, 0, size);
+    ring->data = (char *) mem;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    return ring;
+}
+
+inline void ringDestroy(PyRtRing *ring) {
+    if (!ring) return;
+    free(ring->data);
+    free(ring);
+}
+
+inline size_t ringReadAvailable(PyRtRing *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+        __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
+
+inline size_t ringWriteAvailable(PyRtRing *ring) {
+    return ring->size - (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) -
+        __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+// producer side, returns the number of bytes actually written
+inline size_t ringWrite(PyRtRing *ring, const void *src, size_t len) {
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    size_t space = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    if (len > space) len = space;
+
+    size_t offset = head % ring->size;
+    size_t first = ring->size - offset;
+    if (first > len) first = len;
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const char *) src + first, len - first);
+
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+// consumer side, returns the number of bytes actually read
+inline size_t ringRead(PyRtRing *ring, void *dst, size_t len) {
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t fill = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    if (len > fill) len = fill;
+
+    size_t offset = tail % ring->size;
+    size_t first = ring->size - offset;
+    if (first > len) first = len;
+    memcpy(dst, ring->data + offset, first);
+    memcpy((char *) dst + first, ring->data, len - first);
+
+    __atomic_store_n(&ring->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+#endif
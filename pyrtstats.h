@@ -0,0 +1,55 @@
+#ifndef _PYRTSTATS_
+#define _PYRTSTATS_
+
+#include <time.h>
+#include "RtAudio.h"
+
+// RtAudio counts periods, xruns and the time spent in the callback, in
+// conversions and in the device (see RtAudio::StreamStats). What it
+// cannot see is how long the callback thread waited for the GIL before
+// python code could run; that is counted here. Like the RtAudio counters
+// these are only ever added to by the callback thread, and reset_stats
+// may zero them while it runs.
+
+typedef struct {
+    unsigned long long waits;  // GIL acquisitions by the callback thread
+    unsigned long long nanos;  // total time spent waiting
+    unsigned long long max;    // the longest wait
+} PyRtGilStats;
+
+inline unsigned long long statsNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+inline void gilStatsReset(PyRtGilStats *g) {
+    __atomic_store_n(&g->waits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g->nanos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g->max, 0, __ATOMIC_RELAXED);
+}
+
+inline void gilStatsAdd(PyRtGilStats *g, unsigned long long nanos) {
+    __atomic_fetch_add(&g->waits, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g->nanos, nanos, __ATOMIC_RELAXED);
+    if (nanos > __atomic_load_n(&g->max, __ATOMIC_RELAXED))
+        __atomic_store_n(&g->max, nanos, __ATOMIC_RELAXED);
+}
+
+// the shortest callback time of the bucket the given share of callbacks
+// fits below, 0 before the first callback
+inline unsigned long long statsPercentile(RtAudio::StreamStats const &s, double share) {
+    unsigned long long total = 0;
+    for (unsigned int i = 0; i < RtAudio::STATS_BUCKETS; i++)
+        total += s.histogram[i];
+    if (!total) return 0;
+
+    unsigned long long seen = 0;
+    for (unsigned int i = 0; i < RtAudio::STATS_BUCKETS; i++) {
+        seen += s.histogram[i];
+        if (seen >= share * total) return RtAudio::statsBucketNanos(i);
+    }
+    return RtAudio::statsBucketNanos(RtAudio::STATS_BUCKETS - 1);
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _PYRTTRACE_
+#define _PYRTTRACE_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "RtAudio.h"
+#include "pyrtring.h"
+#include "pyrtstats.h"
+
+// An opt-in timeline of what the stream threads do, see start_trace. Each
+// thread that records events claims a ring of its own, so a ring has a
+// single writer and recording is a timestamp and a few stores. A ring is
+// given back when its thread exits (callback threads come and go with the
+// streams) and the next thread to claim it overwrites the oldest events;
+// every event carries its thread id, so the dump still tells them apart.
+// A full ring overwrites its oldest events too.
+
+#define PYRT_TRACE_THREADS 4
+#define PYRT_TRACE_DEFAULT_EVENTS 65536
+
+// the binding's own events follow the RtAudioTraceEvent ones
+#define PYRT_TRACE_GIL_WAIT 16  // waiting for the GIL
+#define PYRT_TRACE_GIL_HELD 17  // from taking the GIL to giving it back
+#define PYRT_TRACE_PYTHON 18    // the python callback runs
+
+inline char const *traceEventName(unsigned int event) {
+    switch (event) {
+        case RTAUDIO_TRACE_WAKEUP: return "wakeup";
+        case RTAUDIO_TRACE_CALLBACK: return "callback";
+        case RTAUDIO_TRACE_CONVERT: return "convert";
+        case RTAUDIO_TRACE_READ: return "device read";
+        case RTAUDIO_TRACE_WRITE: return "device write";
+        case RTAUDIO_TRACE_OVERFLOW: return "overflow";
+        case RTAUDIO_TRACE_UNDERFLOW: return "underflow";
+        case PYRT_TRACE_GIL_WAIT: return "GIL wait";
+        case PYRT_TRACE_GIL_HELD: return "GIL held";
+        case PYRT_TRACE_PYTHON: return "python callback";
+        default: return "unknown";
+    }
+}
+
+typedef struct {
+    unsigned long long nanos;   // CLOCK_MONOTONIC
+    pid_t tid;
+    unsigned short event;
+    unsigned short phase;       // an RtAudioTracePhase
+} PyRtTraceEvent;
+
+struct PyRtTrace;
+
+typedef struct {
+    struct PyRtTrace *trace;
+    pid_t owner;                // the thread writing the ring, 0 when free
+    PyRtTraceEvent *events;
+    unsigned long long head __attribute__((aligned(PYRT_CACHE_LINE))); // events ever written
+} PyRtTraceRing;
+
+typedef struct PyRtTrace {
+    int enabled;
+    unsigned long long since;   // events before this were recorded by an earlier trace
+    size_t capacity;            // events per ring, a power of two
+    PyRtTraceRing rings[PYRT_TRACE_THREADS];
+} PyRtTrace;
+
+static pthread_key_t traceKey;
+static pthread_once_t traceKeyOnce = PTHREAD_ONCE_INIT;
+
+// runs as a tracing thread exits
+static void traceRelease(void *arg) {
+    PyRtTraceRing *ring = (PyRtTraceRing *) arg;
+    __atomic_store_n(&ring->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void traceMakeKey() {
+    pthread_key_create(&traceKey, traceRelease);
+}
+
+inline PyRtTrace *traceCreate() {
+    pthread_once(&traceKeyOnce, traceMakeKey);
+    PyRtTrace *t = NULL;
+    if (posix_memalign((void **) &t, PYRT_CACHE_LINE, sizeof(PyRtTrace)))
+        return NULL;
+    memset(t, 0, sizeof(PyRtTrace));
+    for (int i = 0; i < PYRT_TRACE_THREADS; i++)
+        t->rings[i].trace = t;
+    return t;
+}
+
+// only while no stream is open, nothing may be recording
+inline int traceAllocate(PyRtTrace *t, size_t events) {
+    size_t capacity = 1;
+    while (capacity < events) capacity <<= 1;
+    if (capacity == t->capacity) return 0;
+
+    for (int i = 0; i < PYRT_TRACE_THREADS; i++) {
+        free(t->rings[i].events);
+        t->rings[i].events = NULL;
+        t->rings[i].head = 0;
+    }
+    t->capacity = 0;
+    for (int i = 0; i < PYRT_TRACE_THREADS; i++) {
+        PyRtTraceEvent *events = (PyRtTraceEvent *) malloc(capacity * sizeof(PyRtTraceEvent));
+        if (!events) return -1;
+        // touch the memory now rather than in the callback
+        memset(events, 0, capacity * sizeof(PyRtTraceEvent));
+        t->rings[i].events = events;
+    }
+    t->capacity = capacity;
+    return 0;
+}
+
+inline void traceDestroy(PyRtTrace *t) {
+    if (!t) return;
+    for (int i = 0; i < PYRT_TRACE_THREADS; i++)
+        free(t->rings[i].events);
+    free(t);
+}
+
+inline PyRtTraceRing *traceRing(PyRtTrace *t) {
+    PyRtTraceRing *ring = (PyRtTraceRing *) pthread_getspecific(traceKey);
+    if (ring && ring->trace == t) return ring;
+    if (ring) return NULL;  // a thread only traces for one stream
+
+    pid_t tid = (pid_t) syscall(SYS_gettid);
+    for (int i = 0; i < PYRT_TRACE_THREADS; i++) {
+        pid_t unclaimed = 0;
+        if (__atomic_compare_exchange_n(&t->rings[i].owner, &unclaimed, tid, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            pthread_setspecific(traceKey, &t->rings[i]);
+            return &t->rings[i];
+        }
+    }
+    return NULL;  // more threads than rings, their events are dropped
+}
+
+inline void traceRecord(PyRtTrace *t, unsigned int event, unsigned int phase) {
+    if (!t || !__atomic_load_n(&t->enabled, __ATOMIC_ACQUIRE)) return;
+    PyRtTraceRing *ring = traceRing(t);
+    if (!ring) return;
+
+    unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    PyRtTraceEvent *e = &ring->events[head & (t->capacity - 1)];
+    e->nanos = statsNanos();
+    e->tid = ring->owner;
+    e->event = (unsigned short) event;
+    e->phase = (unsigned short) phase;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// the RtAudioTraceHook, userData is the PyRtTrace
+static void traceHook(RtAudioTraceEvent event, RtAudioTracePhase phase, void *userData) {
+    traceRecord((PyRtTrace *) userData, event, phase);
+}
+
+// Copies the events of a ring still in it into dst, which has room for
+// the capacity, and returns how many there are. The writer may overwrite
+// the oldest ones meanwhile, those are dropped.
+inline size_t traceCopy(PyRtTrace *t, PyRtTraceRing *ring, PyRtTraceEvent *dst) {
+    unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    unsigned long long first = head > t->capacity ? head - t->capacity : 0;
+    for (unsigned long long i = first; i < head; i++)
+        dst[i - first] = ring->events[i & (t->capacity - 1)];
+
+    // slot head again is being written, so the oldest valid one is one past
+    unsigned long long now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    unsigned long long valid = now >= t->capacity ? now - t->capacity + 1 : 0;
+    size_t skip = valid > first ? (size_t) (valid - first) : 0;
+    if (skip > head - first) skip = (size_t) (head - first);
+
+    size_t n = 0;
+    for (size_t i = skip; i < head - first; i++)
+        if (dst[i].nanos >= t->since) dst[n++] = dst[i];
+    return n;
+}
+
+#endif
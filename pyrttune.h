@@ -0,0 +1,46 @@
+#ifndef _PYRTTUNE_
+#define _PYRTTUNE_
+
+#include <time.h>
+#include "RtAudio.h"
+
+// While autotune runs a trial stream, the chosen callback is wrapped to
+// count the periods the device reported an xrun for and to time the
+// callback. The first periods after a start are left out, they pay for
+// the stream and thread state setup.
+
+#define PYRT_TUNE_WARMUP 8
+
+typedef struct {
+    RtAudioCallback callback;  // the callback being measured
+    void *userData;
+    unsigned long periods;     // periods since the stream was started
+    unsigned long xruns;
+    long nanosMax;             // the slowest callback
+} PyRtTune;
+
+inline void tuneReset(PyRtTune *t) {
+    t->periods = 0;
+    t->xruns = 0;
+    t->nanosMax = 0;
+}
+
+inline int tuneCall(PyRtTune *t, void *out, void *in, unsigned int frames, double streamTime,
+        RtAudioStreamStatus status) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int retcode = t->callback(out, in, frames, streamTime, status, t->userData);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned long periods = __atomic_load_n(&t->periods, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->periods, periods + 1, __ATOMIC_RELAXED);
+    if (periods < PYRT_TUNE_WARMUP) return retcode;
+    if (status)
+        __atomic_store_n(&t->xruns, t->xruns + 1, __ATOMIC_RELAXED);
+    long nanos = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+    if (nanos > t->nanosMax)
+        __atomic_store_n(&t->nanosMax, nanos, __ATOMIC_RELAXED);
+    return retcode;
+}
+
+#endif
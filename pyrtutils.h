@@ -2,6 +2,8 @@
 #define _PYRTUTILS_
 
 #include <Python.h>
+#include <stdint.h>
+#include <string.h>
 #include "RtAudio.h"
 
 void setRuntimeExceptionWithMessage(char const *message) {
@@ -26,12 +28,36 @@ inline int getArgList(PyObject **args, PyObject **bytearray) {
     return 0;
 }
 
+inline int checkResult(PyObject *o) {
+    // an exception escaped from the callback, report it and abort the stream
+    if (!o) {
+        PyErr_Print();
+        return 2;
+    }
+    return 0;
+}
+
 inline int isNone(PyObject *o) {
     if (Py_None == 0)
         return 1;
     return 0;
 }
 
+inline int getReturnCode(PyObject *o) {
+    // same meaning as the return value of a native RtAudioCallback
+    if (o == Py_None)
+        return 0;
+    if (PyInt_Check(o)) {
+        long code = PyInt_AsLong(o);
+        if (code >= 0 && code <= 2)
+            return (int) code;
+    }
+    PyErr_SetString(PyExc_ValueError,
+            "The callback must return None, 0, 1 or 2");
+    PyErr_Print();
+    return 2;
+}
+
 inline int isBuffer(PyObject *o) {
     if (PyObject_CheckBuffer(o))
         return 0;
@@ -41,7 +67,8 @@ inline int isBuffer(PyObject *o) {
 }
 
 inline int getBuffer(PyObject *o, Py_buffer **view) {
-    int error = PyObject_GetBuffer(o, *view, PyBUF_SIMPLE);
+    // ask for format and strides so typed and non-contiguous arrays work
+    int error = PyObject_GetBuffer(o, *view, PyBUF_RECORDS_RO);
     if (error) {
         PyErr_SetString(PyExc_BufferError,
                 "Could not extract buffer from object");
@@ -83,6 +110,216 @@ inline unsigned int widthFromFormat(RtAudioFormat fmt) {
     return w;
 }
 
+// struct module code of the samples, as used in the buffer interface
+inline char const *formatCodeFromFormat(RtAudioFormat fmt) {
+    switch (fmt) {
+        case RTAUDIO_SINT8:
+            return "b";
+        case RTAUDIO_SINT16:
+            return "h";
+        case RTAUDIO_SINT24:
+        case RTAUDIO_SINT32:
+            return "i";
+        case RTAUDIO_FLOAT32:
+            return "f";
+        case RTAUDIO_FLOAT64:
+            return "d";
+        default:
+            return "B";
+    }
+}
+
+inline int checkLayout(Py_buffer *view, RtAudioFormat fmt, unsigned int channels, int planar) {
+    // anything exported as plain bytes is taken as raw sample data
+    char const *code = view->format ? view->format : "B";
+    if (view->itemsize == 1 && (!strcmp(code, "B") || !strcmp(code, "c")))
+        return 0;
+
+    // native byte order only, which numpy spells '<' or '>' explicitly
+#ifdef WORDS_BIGENDIAN
+    char const nativeOrder = '>';
+#else
+    char const nativeOrder = '<';
+#endif
+    if (*code == '@' || *code == '=' || *code == nativeOrder)
+        code++;
+    char const *expected = formatCodeFromFormat(fmt);
+    int match = view->itemsize == (Py_ssize_t) widthFromFormat(fmt) && code[0] && !code[1] &&
+        (code[0] == expected[0] || (code[0] == 'l' && expected[0] == 'i' && sizeof(long) == 4));
+    if (!match) {
+        PyErr_SetString(PyExc_BufferError,
+                "The returned array does not match the stream sample format");
+        return 2;
+    }
+
+    if (view->ndim == 2 && view->shape &&
+            view->shape[planar ? 0 : 1] != (Py_ssize_t) channels) {
+        PyErr_SetString(PyExc_BufferError, planar ?
+                "The returned array must have the shape (channels, frames)" :
+                "The returned array must have the shape (frames, channels)");
+        return 2;
+    }
+    if (view->ndim > 2) {
+        PyErr_SetString(PyExc_BufferError,
+                "The returned array must have one or two dimensions");
+        return 2;
+    }
+    return 0;
+}
+
+template <typename T>
+inline void gatherSamples(T *dst, char const *src, Py_ssize_t rows, Py_ssize_t cols,
+        Py_ssize_t rowStride, Py_ssize_t colStride) {
+    for (Py_ssize_t r = 0; r < rows; r++) {
+        char const *p = src + r * rowStride;
+        for (Py_ssize_t c = 0; c < cols; c++, p += colStride)
+            *dst++ = *(T const *) p;
+    }
+}
+
+// copies a checked buffer into the stream in C order, gathering the
+// samples of strided and fortran ordered arrays without an intermediate copy
+inline void copyFromBuffer(void *dst, Py_buffer *view) {
+    if (!view->strides || PyBuffer_IsContiguous(view, 'C')) {
+        memcpy(dst, view->buf, view->len);
+        return;
+    }
+
+    Py_ssize_t rows = view->shape[0];
+    Py_ssize_t cols = view->ndim == 2 ? view->shape[1] : 1;
+    Py_ssize_t rowStride = view->strides[0];
+    Py_ssize_t colStride = view->ndim == 2 ? view->strides[1] : 0;
+    char const *src = (char const *) view->buf;
+    switch (view->itemsize) {
+        case 1:
+            gatherSamples((int8_t *) dst, src, rows, cols, rowStride, colStride);
+            break;
+        case 2:
+            gatherSamples((int16_t *) dst, src, rows, cols, rowStride, colStride);
+            break;
+        case 4:
+            gatherSamples((int32_t *) dst, src, rows, cols, rowStride, colStride);
+            break;
+        case 8:
+            gatherSamples((int64_t *) dst, src, rows, cols, rowStride, colStride);
+            break;
+        default:
+            PyBuffer_ToContiguous(dst, view, view->len, 'C');
+            break;
+    }
+}
+
+inline int getFlagOption(PyObject *dict, char const *key, int fallback = 0) {
+    if (!dict || !PyDict_Check(dict))
+        return fallback;
+    PyObject *value = PyDict_GetItemString(dict, key);
+    if (!value)
+        return fallback;
+    return PyObject_IsTrue(value) == 1;
+}
+
+inline int getIntOption(PyObject *dict, char const *key, long *value) {
+    if (!dict || !PyDict_Check(dict))
+        return 0;
+    PyObject *o = PyDict_GetItemString(dict, key);
+    if (!o || o == Py_None)
+        return 0;
+    if (!PyInt_Check(o) && !PyLong_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "Stream option '%s' must be an integer", key);
+        return 2;
+    }
+    *value = PyInt_AsLong(o);
+    if (*value == -1 && PyErr_Occurred())
+        return 2;
+    return 0;
+}
+
+inline int getDoubleOption(PyObject *dict, char const *key, double *value) {
+    if (!dict || !PyDict_Check(dict))
+        return 0;
+    PyObject *o = PyDict_GetItemString(dict, key);
+    if (!o || o == Py_None)
+        return 0;
+    if (!PyFloat_Check(o) && !PyInt_Check(o) && !PyLong_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "Stream option '%s' must be a number", key);
+        return 2;
+    }
+    *value = PyFloat_AsDouble(o);
+    if (*value == -1 && PyErr_Occurred())
+        return 2;
+    return 0;
+}
+
+inline int getStringOption(PyObject *dict, char const *key, char const **value) {
+    if (!dict || !PyDict_Check(dict))
+        return 0;
+    PyObject *o = PyDict_GetItemString(dict, key);
+    if (!o || o == Py_None)
+        return 0;
+    if (!PyString_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "Stream option '%s' must be a string", key);
+        return 2;
+    }
+    *value = PyString_AS_STRING(o);
+    return 0;
+}
+
+// addresses are given as integers, e.g. from ctypes.addressof()
+inline int getPointerOption(PyObject *dict, char const *key, void **value) {
+    if (!dict || !PyDict_Check(dict))
+        return 0;
+    PyObject *o = PyDict_GetItemString(dict, key);
+    if (!o || o == Py_None)
+        return 0;
+    if (!PyInt_Check(o) && !PyLong_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "Stream option '%s' must be an address", key);
+        return 2;
+    }
+    *value = PyLong_AsVoidPtr(o);
+    return PyErr_Occurred() ? 2 : 0;
+}
+
+// Finds the address of a native RtAudioCallback: a plain integer (e.g. a
+// cffi callback cast to uintptr_t, or the address of a numba cfunc) or a
+// ctypes function pointer. Sets fn to NULL for anything else, which is
+// then treated as a python callable, whatever attributes it has.
+inline int getNativeCallback(PyObject *callback, void **fn) {
+    PyObject *address = NULL;
+    *fn = NULL;
+
+    if (PyInt_Check(callback) || PyLong_Check(callback)) {
+        Py_INCREF(callback);
+        address = callback;
+    } else {
+        // a ctypes function pointer can only exist if ctypes was imported
+        PyObject *ctypes = PyDict_GetItemString(PyImport_GetModuleDict(), "ctypes");
+        if (!ctypes) return 0;
+        PyObject *type = PyObject_GetAttrString(ctypes, "_CFuncPtr");
+        int isFuncPtr = type ? PyObject_IsInstance(callback, type) : -1;
+        Py_XDECREF(type);
+        if (isFuncPtr < 0) return 2;
+        if (!isFuncPtr) return 0;
+        PyObject *voidpType = PyObject_GetAttrString(ctypes, "c_void_p");
+        if (!voidpType) return 2;
+        PyObject *voidp = PyObject_CallMethod(ctypes, (char *) "cast", (char *) "OO", callback, voidpType);
+        Py_DECREF(voidpType);
+        if (!voidp) return 2;
+        address = PyObject_GetAttrString(voidp, "value");
+        Py_DECREF(voidp);
+    }
+    if (!address) return 2;
+
+    if (PyInt_Check(address) || PyLong_Check(address))
+        *fn = PyLong_AsVoidPtr(address);
+    Py_DECREF(address);
+    if (PyErr_Occurred()) return 2;
+    if (!*fn) {
+        PyErr_SetString(PyExc_ValueError, "Native callback address must be a non-zero integer");
+        return 2;
+    }
+    return 0;
+}
+
 RtAudio::StreamParameters *populateStreamParameters(PyObject *dict) {
     PyObject *device = PyDict_GetItemString(dict, "device_id");
     PyObject *channels = PyDict_GetItemString(dict, "channels");
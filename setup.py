@@ -1,8 +1,12 @@
 from distutils.core import setup, Extension
 
 module = Extension('pyrtaudio', sources=['pyrtaudio.cpp', 'RtAudio.cpp'],
-        define_macros=[('__LINUX_ALSA__', '')],
-        libraries=['asound','pthread'])
+        # Python.h defines HAVE_GETTIMEOFDAY for pyrtaudio.cpp, RtAudio.cpp
+        # must see it too or the two disagree on the layout of RtApi
+        define_macros=[('__LINUX_ALSA__', ''), ('HAVE_GETTIMEOFDAY', '1')],
+        libraries=['asound','pthread'],
+        # lets the dense sample conversion loops in RtAudio.cpp use SIMD
+        extra_compile_args=['-ftree-vectorize'])
 
 setup(name='pyrtaudio',
         version='0.1',
@@ -0,0 +1,43 @@
+import pyrtaudio as p
+import signal, sys, time
+
+## stopping a stream whose callback is waiting for the GIL
+# The main thread keeps the GIL to itself for a few periods, so the next
+# callback blocks on it, and stops or aborts the stream right then. If
+# stop_stream or abort_stream held on to the GIL while RtAudio waits for
+# the callback thread, the two would wait for each other forever; the
+# alarm turns such a hang into a failure.
+device = int(sys.argv[1]) if len(sys.argv) > 1 else 0
+rate = 48000
+bframes = 64
+period = float(bframes) / rate
+
+calls = [0]
+def callback(output):
+    calls[0] += 1
+    return 0
+
+def run(stop):
+    r = p.RtAudio()
+    r.open_stream({'device_id':device, 'channels':2, 'first_channel':0},
+            None, p.RTAUDIO_SINT16, rate, bframes, callback, {'in_place': True})
+    r.start_stream()
+    time.sleep(20 * period)
+    signal.alarm(5)
+    # stop_stream and abort_stream are entered with the GIL still held
+    interval = sys.getcheckinterval()
+    sys.setcheckinterval(1 << 30)
+    end = time.time() + 5 * period
+    while time.time() < end:
+        pass
+    getattr(r, stop)()
+    sys.setcheckinterval(interval)
+    signal.alarm(0)
+    stopped = not r.is_stream_running()
+    # the callback that was waiting gets the GIL back and returns
+    time.sleep(10 * period)
+    r.close_stream()
+    return stopped and calls[0] > 0
+
+for stop in ('stop_stream', 'abort_stream'):
+    print '%-14s %s' % (stop, 'ok' if run(stop) else 'FAILED')